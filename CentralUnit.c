@@ -1,46 +1,230 @@
 #include "contiki.h"
 #include "net/rime/rime.h"
+#include "net/netstack.h"
 #include "sys/etimer.h"
 #include "stdio.h"
+#include <string.h>
 #include "dev/button-sensor.h"
+#include "dev/serial-line.h"
+#include "cfs/cfs.h"
+#include "message.h"
+#include "stats.h"
+#include "home.h"
+#include "sensorcache.h"
+#include "transport.h"
+#include "discovery.h"
+#include "groupack.h"
+#include "statesync.h"
+#include "schedule.h"
+#include "console.h"
+#include "series.h"
+#include "bulk.h"
+#include "loader.h"
+#if SCHEDULE_CONF_TIMESYNCH
+#include "net/rime/timesynch.h"
+#endif
 
 
 #define MAX_RETRANSMISSIONS 5
-
-//unlocked (0) by default
-static int alarm_state = 0;
-//gate locked(1) by default
-static int gate_locked = 1;
-//extension not enabled(0) by default
-static int extension_active =0;
+//max number of commands carried by a single frame
+#define MAX_BATCH 8
+//commands issued within this window towards the same node share a frame
+#define BATCH_DELAY (CLOCK_SECOND/4)
+//time between the copies of the broadcast to the extension nodes
+#define REPEAT_INTERVAL (CLOCK_SECOND/2)
+//max size of the arguments of a command (subscription or state vector)
+#define MAX_ARGS ((MSG_SUBSCRIBE_LEN > STATESYNC_LEN)?MSG_SUBSCRIBE_LEN:\
+                                                              STATESYNC_LEN)
+
+//alarm, gate and extension, replicated on the nodes (see statesync.h)
+static struct home_state state;
+
+//boot counter of the CU, on the flash. Sent with every command (see dedup.h)
+#define EPOCH_FILE "epoch"
+static uint16_t epoch;
 
 static int command = 0;
 static int button_pressed = 0;
 
+//commands waiting to be sent, grouped by destination
+struct pending_command {
+  uint8_t type;
+  uint8_t len;
+  uint8_t args[MAX_ARGS];
+};
+static struct pending_command pending_commands[DEST_NUM][MAX_BATCH];
+static uint8_t pending_count[DEST_NUM];
+static struct ctimer batch_timer;
+
+/*
+  the commands of a destination go to every node with its capability, one
+  frame per node. The fan-out in progress carries the first fanout_count 
+  pending commands, next_target is the next node (see discovery_next)
+*/
+static const uint16_t dest_caps[DEST_NUM] = {
+  DISCOVERY_CAP_ALARM,          //DEST_REGULAR_NODES
+  DISCOVERY_CAP_PRESENCE,       //DEST_EXTENSION_NODE
+  DISCOVERY_CAP_TEMPERATURE,    //DEST_NODE1
+  DISCOVERY_CAP_GATE            //DEST_NODE2
+};
+static uint8_t fanout_count[DEST_NUM];
+static uint8_t next_target[DEST_NUM];
+
+//group command to the regular nodes waiting for the acks (see groupack.h)
+static struct groupack group;
+static uint8_t group_active = 0;
+#if !TRANSPORT_CONF_MULTIHOP
+static uint8_t group_rounds;
+static struct queuebuf *group_frame;
+static struct ctimer group_timer;
+#endif
+
+#if !TRANSPORT_CONF_MULTIHOP && COMMAND_REPEAT
+//copies of the last broadcast to the extension nodes still to be sent
+static struct queuebuf *repeat_frame;
+static uint8_t repeat_left;
+static struct ctimer repeat_timer;
+#endif
+
+//last mean temperature of Node1 and light of Node2
+static struct sensorcache temperature_cache, light_cache;
+#if SENSOR_CACHE_REFRESH_PERIOD
+static struct ctimer refresh_timer;
+#endif
+//series uploaded by the door and the garden nodes (see bulk.h)
+static struct bulk door_bulk, garden_bulk;
+
+static void flush_commands(void *ptr);
+static void group_end(void);
+
 PROCESS(handle_command_process, "Handle command process");
 PROCESS(display_process, "Display the available commands");
 AUTOSTART_PROCESSES(&handle_command_process);
   
 
-static void broadcast_recv(struct broadcast_conn *c, const linkaddr_t *senderAddr){
-<<<<<<< HEAD
-  printf("broadcast message received from %d.%d.\n", senderAddr->u8[0], 
-				senderAddr->u8[1]);
-=======
-  printf("broadcast message received from %d.%d: '%s'\n", senderAddr->u8[0], 
-				senderAddr->u8[1], (char *)packetbuf_dataptr());
->>>>>>> origin/master
+/*******************************************************************************
+  node 1.0 refused to activate the alarm: the door is being opened
+*******************************************************************************/
+static void alarm_refused(void){
+  //the alarm is switched off by the new state vector of the node
+  printf("error 403: Node 1.0 refuse to activate the alarm\n");
+}
 
-  int* data = (int*)packetbuf_dataptr();
-  int measurement = *data;
 
-  if (measurement == 4031){
-    printf("error 403: Node 1.0 refuse to activate the alarm\n");
-    alarm_state = 0;
+/*******************************************************************************
+  a node has changed the state (node 1.0 refused the alarm), or the CU has
+  rebooted and got the state back from the nodes
+*******************************************************************************/
+static void state_changed(void){
+  //display the available commands
+  process_start(&display_process, NULL);
+}
 
-    //display the available commands
-    process_start(&display_process, NULL);
+
+/*******************************************************************************
+  statistics of the temperature history of the door node
+*******************************************************************************/
+static void history_received(const struct msg_tlv *tlv){
+  char text[40];
+
+  sprintf(text, "history %u %d %d %d", msg_get_u16(tlv->value),
+          (int16_t)msg_get_u16(tlv->value + 2),
+          (int16_t)msg_get_u16(tlv->value + 4),
+          (int16_t)msg_get_u16(tlv->value + 6));
+
+  printf("Received %s\n", text);
+  console_answer_text(MSG_CMD_HISTORY, text);
+}
+
+
+/*******************************************************************************
+  series of samples uploaded by a node, oldest first
+*******************************************************************************/
+static void print_series(const uint8_t *block, uint16_t len){
+  struct series_reader reader;
+  unsigned long age;
+  int16_t value;
+
+  //a transfer cut short, or stale chunks, must not be printed as samples
+  if (series_check(block, len) < 0 || series_open(&reader, block, len) < 0){
+    printf("Error: malformed series of %u bytes, dropped\n", len);
+    return;
   }
+
+  printf("Series of %s: %u samples every %u s, the last %u s ago\n",
+          (reader.reading == MSG_TLV_TEMPERATURE)?"temperature":"light",
+          reader.count, reader.period, reader.age);
+
+  while (series_next(&reader, &value, &age) > 0)
+    printf("%d ", value);
+  printf("\n");
+}
+
+
+static void bulk_received(const linkaddr_t *from, const uint8_t *data,
+                                                                uint16_t len){
+  printf("Bulk of %u bytes from %d.%d\n", len, from->u8[0], from->u8[1]);
+  print_series(data, len);
+}
+
+
+/*******************************************************************************
+  frame from a node in the packetbuf: replies, pushed readings and errors
+*******************************************************************************/
+static void handle_reply(void){
+  struct msg_reader reader;
+  struct msg_tlv tlv;
+  const char *origin;
+
+  if (msg_open(&reader) < 0){
+    printf("Error: malformed message\n");
+    return;
+  }
+
+  //a reply to a request or a reading pushed by a subscribed node
+  origin = (reader.opcode == MSG_OP_PUSH)?"Pushed":"Received";
+
+  while (msg_next(&reader, &tlv) > 0){
+    switch (tlv.type){
+      case MSG_TLV_TEMPERATURE:
+        printf("%s temperature = %d\n", origin, msg_tlv_int16(&tlv));
+        sensorcache_update(&temperature_cache, msg_tlv_int16(&tlv));
+        console_answer(MSG_CMD_TEMPERATURE, "temperature", msg_tlv_int16(&tlv));
+        break;
+      case MSG_TLV_HISTORY:
+        if (tlv.len == MSG_TLV_HISTORY_LEN)
+          history_received(&tlv);
+        break;
+      case MSG_TLV_SERIES:
+        //a series over the multi-hop transport
+        print_series(tlv.value, tlv.len);
+        break;
+      case MSG_TLV_LIGHT:
+        printf("%s light = %d\n", origin, msg_tlv_int16(&tlv));
+        sensorcache_update(&light_cache, msg_tlv_int16(&tlv));
+        console_answer(MSG_CMD_LIGHT, "light", msg_tlv_int16(&tlv));
+        break;
+      case MSG_TLV_ERROR:
+        if (msg_tlv_u8(&tlv) == MSG_ERR_ALARM_REFUSED)
+          alarm_refused();
+        break;
+      case MSG_TLV_ACK:
+        //every member has answered: no need to wait for the deadline
+        if (group_active && groupack_recv(&group, &tlv))
+          group_end();
+        break;
+      default:
+        printf("Error: unknown entry %d\n", tlv.type);
+    }
+  }
+}
+
+
+static void broadcast_recv(struct broadcast_conn *c, const linkaddr_t *senderAddr){
+  printf("broadcast message received from %d.%d.\n", senderAddr->u8[0], 
+				senderAddr->u8[1]);
+
+  handle_reply();
 }
 
 /*
@@ -60,19 +244,15 @@ static void broadcast_sent(struct broadcast_conn *c, int status, int num_tx){
 static void recv_runicast(struct runicast_conn *c, const linkaddr_t *sender_addr, uint8_t seqno){
   printf("runicast message received from %d.%d. Sequence number = %d\n", sender_addr->u8[0], sender_addr->u8[1], seqno);
 
-  int* data = (int*)packetbuf_dataptr();
-  int measurement = *data;
-
-  if (sender_addr->u8[0] == 1 && sender_addr->u8[1] == 0 && command == 4)
-    printf("Received temperature = %d\n", measurement);
-
-  if (sender_addr->u8[0] == 2 && sender_addr->u8[1] == 0 && command == 5)
-    printf("Received light = %d\n", measurement);
+  handle_reply();
 }
 
 static void sent_runicast(struct runicast_conn *c, const linkaddr_t *receiver_addr, uint8_t retransmissions)
 {
   printf("runicast message sent to %d.%d, retransmissions %d\n", receiver_addr->u8[0], receiver_addr->u8[1], retransmissions);
+
+  //the connection is free again: send what has been queued in the meanwhile
+  ctimer_set(&batch_timer, 0, flush_commands, NULL);
 }
 
 /*
@@ -82,8 +262,41 @@ static void timedout_runicast(struct runicast_conn *c, const linkaddr_t *receive
 {
   printf("runicast message timed out when sending to %d.%d, retransmissions %d\n", 
                          receiver_addr->u8[0], receiver_addr->u8[1], retransmissions);
+
+  ctimer_set(&batch_timer, 0, flush_commands, NULL);
 }
 
+#if TRANSPORT_CONF_MULTIHOP
+static void recv_multihop(const linkaddr_t *from, uint8_t hops){
+  struct msg_reader reader;
+
+  printf("multihop message received from %d.%d, %d hops\n", from->u8[0],
+                                                        from->u8[1], hops);
+
+  if (msg_open(&reader) < 0){
+    printf("Error: malformed message\n");
+    return;
+  }
+
+  //the energy reports and the capabilities travel along the collect tree too
+  if (reader.opcode == MSG_OP_STATS)
+    stats_print_report(from);
+  else if (reader.opcode == MSG_OP_ANNOUNCE)
+    discovery_recv(from);
+  else
+    handle_reply();
+}
+
+
+//the route of the last frame is known: send the next one
+static void transport_ready(void){
+  ctimer_set(&batch_timer, 0, flush_commands, NULL);
+}
+
+static const struct transport_callbacks transport_calls = {recv_multihop, 
+                                                            transport_ready};
+#endif
+
 //Be careful to the order
 static const struct broadcast_callbacks broadcast_call = {broadcast_recv, broadcast_sent}; 
 static struct broadcast_conn broadcast_regular_node, broadcast_extension_node;
@@ -91,9 +304,508 @@ static const struct runicast_callbacks runicast_calls = {recv_runicast, sent_run
 static struct runicast_conn runicast_node2, runicast_node1;
 
 
+/*******************************************************************************
+  queue a command, with len bytes of arguments, for a destination. The frame is
+  sent after BATCH_DELAY, so that the commands issued in the meanwhile for the
+  same node travel together
+*******************************************************************************/
+static int enqueue_command_args(uint8_t dest, uint8_t cmd, const void *args,
+                                                                uint8_t len){
+  struct pending_command *p;
+
+  if (pending_count[dest] >= MAX_BATCH || len > MAX_ARGS){
+    printf("Error: too many pending commands.\n");
+    return -1;
+  }
+
+  p = &pending_commands[dest][pending_count[dest]++];
+  p->type = cmd;
+  p->len = len;
+  if (len > 0)
+    memcpy(p->args, args, len);
+  ctimer_set(&batch_timer, BATCH_DELAY, flush_commands, NULL);
+
+  return 0;
+}
+
+
+//command without arguments
+static int enqueue_command(uint8_t dest, uint8_t cmd){
+  return enqueue_command_args(dest, cmd, NULL, 0);
+}
+
+
+/*******************************************************************************
+  count the boots of the CU. The counter is little endian on the flash: the
+  zero bytes that Coffee drops from the end of a file (see history.c) are the
+  high ones, read back as 0
+*******************************************************************************/
+static void load_epoch(void){
+  uint8_t buf[2] = {0, 0};
+  int fd;
+
+  fd = cfs_open(EPOCH_FILE, CFS_READ);
+  if (fd >= 0){
+    cfs_read(fd, buf, sizeof(buf));
+    cfs_close(fd);
+  }
+
+  //0 is the epoch of a CU without the counter
+  epoch = msg_get_u16(buf) + 1;
+  if (epoch == 0)
+    epoch = 1;
+
+  msg_put_u16(buf, epoch);
+  cfs_remove(EPOCH_FILE);
+  fd = cfs_open(EPOCH_FILE, CFS_WRITE);
+  if (fd >= 0){
+    cfs_write(fd, buf, sizeof(buf));
+    cfs_close(fd);
+  }
+
+  printf("Boot %u of the CU\n", epoch);
+}
+
+
+/*******************************************************************************
+  build a frame with the first count pending commands of a destination
+*******************************************************************************/
+static void build_frame(uint8_t dest, uint8_t count){
+  struct pending_command *p;
+  uint8_t buf[2];
+  uint8_t i;
+
+#if TRANSPORT_CONF_MULTIHOP
+  msg_begin(MSG_OP_COMMAND, 0);
+#else
+  uint8_t seqno = msg_begin(MSG_OP_COMMAND, 0);
+
+  //the regular nodes acknowledge the broadcast (see groupack.h)
+  if (dest == DEST_REGULAR_NODES)
+    groupack_begin(&group, seqno, dest_caps[dest]);
+#endif
+
+  //a rebooted CU restarts the sequence numbers (see dedup.h)
+  msg_put_u16(buf, epoch);
+  msg_append(MSG_TLV_EPOCH, buf, sizeof(buf));
+
+  //one entry for each command, with its arguments
+  for (i = 0; i < count; i++){
+    p = &pending_commands[dest][i];
+
+    /*
+      the start of OPEN is chosen by the first frame that carries it, not when
+      the command is queued: the batch delay and a busy connection would eat
+      the lead. The other frames of a fan-out keep the same instant
+    */
+    if (p->type == MSG_CMD_OPEN && p->len == 0){
+      msg_put_u16(p->args, schedule_now() + SCHEDULE_LEAD);
+      p->len = MSG_OPEN_LEN;
+    }
+
+    msg_append(p->type, p->args, p->len);
+  }
+
+  if (count > 1)
+    printf("%d commands sent in a single frame\n", count);
+}
+
+
+//remove the first count pending commands of a destination
+static void remove_commands(uint8_t dest, uint8_t count){
+  pending_count[dest] -= count;
+  memmove(pending_commands[dest], pending_commands[dest] + count,
+                      pending_count[dest] * sizeof(struct pending_command));
+}
+
+
+/*******************************************************************************
+  send the frame of a fan-out to the next node with the capability of the
+  destination. Return 0 when every node has got the frame: the commands of the
+  fan-out are removed, the ones queued in the meanwhile start the next one
+*******************************************************************************/
+static int fanout_next(uint8_t dest){
+  const linkaddr_t *target;
+
+  if (fanout_count[dest] == 0){
+    fanout_count[dest] = pending_count[dest];
+    next_target[dest] = 0;
+
+    if (discovery_count(dest_caps[dest]) == 0)
+      printf("Error: no node can execute the command, discarded.\n");
+  }
+
+  target = discovery_next(dest_caps[dest], &next_target[dest]);
+  if (target == NULL){
+    remove_commands(dest, fanout_count[dest]);
+    fanout_count[dest] = 0;
+    return 0;
+  }
+
+  build_frame(dest, fanout_count[dest]);
+
+#if TRANSPORT_CONF_MULTIHOP
+  transport_send_to_node(target);
+#else
+  runicast_send((dest == DEST_NODE1)?&runicast_node1:&runicast_node2, target,
+                                                        MAX_RETRANSMISSIONS);
+#endif
+
+  return 1;
+}
+
+
+#if !TRANSPORT_CONF_MULTIHOP
+/*******************************************************************************
+  the group command is over: every member answered or the last round expired
+*******************************************************************************/
+static void group_end(void){
+  ctimer_stop(&group_timer);
+  groupack_report(&group);
+
+  if (group_frame != NULL){
+    queuebuf_free(group_frame);
+    group_frame = NULL;
+  }
+  group_active = 0;
+
+  //the next group command can go
+  ctimer_set(&batch_timer, 0, flush_commands, NULL);
+}
+
+
+/*******************************************************************************
+  deadline of a round: the frame is broadcast again for the missing members
+*******************************************************************************/
+static void group_deadline(void *ptr){
+  if (group_rounds >= GROUPACK_MAX_ROUNDS || group_frame == NULL){
+    group_end();
+    return;
+  }
+
+  group_rounds++;
+  printf("Group command %d: missing 0x%02x, round %d\n", group.seqno,
+                                      groupack_missing(&group), group_rounds);
+
+  queuebuf_to_packetbuf(group_frame);
+  broadcast_send(&broadcast_regular_node);
+  ctimer_set(&group_timer, GROUPACK_DEADLINE, group_deadline, NULL);
+}
+
+
+/*******************************************************************************
+  the group command in the packetbuf is going to be broadcast: keep a copy for
+  the retransmissions and wait for the acks
+*******************************************************************************/
+static void group_start(void){
+  //no member discovered yet: nobody to wait for
+  if (group.count == 0)
+    return;
+
+  group_frame = queuebuf_new_from_packetbuf();
+  group_rounds = 1;
+  group_active = 1;
+  ctimer_set(&group_timer, GROUPACK_DEADLINE, group_deadline, NULL);
+}
+#else
+//the multi-hop fan-out does not use group commands
+static void group_end(void){
+}
+#endif
+
+
+#if !TRANSPORT_CONF_MULTIHOP && COMMAND_REPEAT
+/*******************************************************************************
+  the broadcast to the extension nodes is not acknowledged: the same frame
+  (same sequence number) is sent again, the nodes drop the copies
+*******************************************************************************/
+static void repeat_send(void *ptr){
+  queuebuf_to_packetbuf(repeat_frame);
+  broadcast_send(&broadcast_extension_node);
+
+  if (--repeat_left > 0){
+    ctimer_reset(&repeat_timer);
+    return;
+  }
+
+  queuebuf_free(repeat_frame);
+  repeat_frame = NULL;
+}
+
+
+//the frame in the packetbuf is going to be broadcast: keep a copy
+static void repeat_start(void){
+  //a newer frame replaces the copies of the previous one
+  if (repeat_frame != NULL){
+    ctimer_stop(&repeat_timer);
+    queuebuf_free(repeat_frame);
+  }
+
+  repeat_frame = queuebuf_new_from_packetbuf();
+  if (repeat_frame == NULL)
+    return;
+
+  repeat_left = COMMAND_REPEAT;
+  ctimer_set(&repeat_timer, REPEAT_INTERVAL, repeat_send, NULL);
+}
+#endif
+
+
+/*******************************************************************************
+  send the pending commands. A broadcast destination gets one frame with every
+  pending command, the others a fan-out, one node at a time. A connection 
+  still busy keeps its commands: they are sent by the sent/timedout callbacks,
+  together with whatever has been queued in the meanwhile
+*******************************************************************************/
+static void flush_commands(void *ptr){
+  uint8_t dest;
+
+  for (dest = 0; dest < DEST_NUM; dest++){
+    if (pending_count[dest] == 0)
+      continue;
+
+#if TRANSPORT_CONF_MULTIHOP
+    //no broadcast over several hops: every destination is a fan-out. One 
+    //frame at a time, the transport calls back when it is done
+    if (transport_busy())
+      return;
+#else
+    if (dest == DEST_REGULAR_NODES || dest == DEST_EXTENSION_NODE){
+      //one group command at a time
+      if (dest == DEST_REGULAR_NODES && group_active)
+        continue;
+
+      build_frame(dest, pending_count[dest]);
+      pending_count[dest] = 0;
+      if (dest == DEST_REGULAR_NODES)
+        group_start();
+#if COMMAND_REPEAT
+      else
+        repeat_start();
+#endif
+
+      broadcast_send((dest == DEST_REGULAR_NODES)?&broadcast_regular_node:
+                                                  &broadcast_extension_node);
+      continue;
+    }
+
+    if ((dest == DEST_NODE1 && runicast_is_transmitting(&runicast_node1)) ||
+        (dest == DEST_NODE2 && runicast_is_transmitting(&runicast_node2)))
+      continue;
+#endif
+
+    while (pending_count[dest] > 0 && !fanout_next(dest))
+      ;
+  }
+}
+
+
+
+/*******************************************************************************
+  ask the node for a new temperature/light reading. With push telemetry the 
+  subscription is sent again: the node pushes the reading at its next sample 
+  and keeps pushing it, even if it has rebooted and forgotten the old one
+*******************************************************************************/
+static void refresh_reading(uint8_t cmd, uint8_t dest){
+#if TELEMETRY_CONF_PUSH
+  uint8_t args[MSG_SUBSCRIBE_LEN];
+
+  if (cmd == MSG_CMD_TEMPERATURE){
+    args[0] = MSG_TLV_TEMPERATURE;
+    msg_put_u16(args + 1, TELEMETRY_TEMPERATURE_DELTA);
+  }else{
+    args[0] = MSG_TLV_LIGHT;
+    msg_put_u16(args + 1, TELEMETRY_LIGHT_DELTA);
+  }
+  msg_put_u16(args + 3, TELEMETRY_MAX_INTERVAL);
+
+  enqueue_command_args(dest, MSG_CMD_SUBSCRIBE, args, sizeof(args));
+#else
+  enqueue_command(dest, cmd);
+#endif
+}
+
+
+/*******************************************************************************
+  answer a temperature/light request from the cache. A stale or missing
+  reading is refreshed: the reply of the node updates the cache. A request of
+  the console (id) without a reading is answered by the reply of the node
+*******************************************************************************/
+static void read_sensor(uint8_t cmd, uint8_t dest, uint16_t id){
+  struct sensorcache *entry;
+  const char *name;
+
+  if (cmd == MSG_CMD_TEMPERATURE){
+    entry = &temperature_cache;
+    name = "temperature";
+  }else{
+    entry = &light_cache;
+    name = "light";
+  }
+
+  switch (sensorcache_lookup(entry, SENSOR_CACHE_MAX_AGE)){
+    case SENSORCACHE_FRESH:
+      printf("Cached %s = %d (%lu s old)\n", name, entry->value, 
+                                                    sensorcache_age(entry));
+      console_respond_value(id, name, entry->value, sensorcache_age(entry));
+      return;
+    case SENSORCACHE_STALE:
+      printf("Cached %s = %d (%lu s old, refreshing)\n", name, entry->value,
+                                                    sensorcache_age(entry));
+      console_respond_value(id, name, entry->value, sensorcache_age(entry));
+      break;
+    default:
+      printf("No %s available yet, asking the node\n", name);
+      if (console_wait(id, cmd, SENSORCACHE_REFRESH_TIMEOUT) < 0)
+        console_respond(id, "busy");
+  }
+
+  if (sensorcache_start_refresh(entry))
+    refresh_reading(cmd, dest);
+}
+
+
+#if SENSOR_CACHE_REFRESH_PERIOD
+/*******************************************************************************
+  background refresh of the stale readings, so that most of the requests of 
+  the user find a fresh value
+*******************************************************************************/
+static void refresh_cache(void *ptr){
+  if (sensorcache_lookup(&temperature_cache, SENSOR_CACHE_MAX_AGE) != 
+                          SENSORCACHE_FRESH && 
+                          sensorcache_start_refresh(&temperature_cache))
+    refresh_reading(MSG_CMD_TEMPERATURE, DEST_NODE1);
+
+  if (sensorcache_lookup(&light_cache, SENSOR_CACHE_MAX_AGE) != 
+                          SENSORCACHE_FRESH &&
+                          sensorcache_start_refresh(&light_cache))
+    refresh_reading(MSG_CMD_LIGHT, DEST_NODE2);
+
+  ctimer_reset(&refresh_timer);
+}
+#endif
+
+
+static void node_found(const linkaddr_t *addr, uint16_t caps){
+  printf("Discovered node %d.%d, capabilities 0x%02x\n", addr->u8[0],
+                                                        addr->u8[1], caps);
+
+#if TELEMETRY_CONF_PUSH
+  //from now on the node pushes its readings
+  if (caps & DISCOVERY_CAP_TEMPERATURE)
+    refresh_reading(MSG_CMD_TEMPERATURE, DEST_NODE1);
+  if (caps & DISCOVERY_CAP_LIGHT)
+    refresh_reading(MSG_CMD_LIGHT, DEST_NODE2);
+#endif
+}
+
+
+/*******************************************************************************
+  a line of a module for the nodes (see loader.h): without bytes it starts a
+  new module
+*******************************************************************************/
+static void module_line(const uint8_t *data, int len){
+  long size;
+
+  if (len < 0)
+    console_respond_module(-1);
+  else if (len == 0){
+    loader_begin();
+    console_respond_module(0);
+  }
+  else{
+    size = loader_append(data, len);
+    console_respond_module((size < 0)?-2:size);
+  }
+}
+
+
+/*******************************************************************************
+  run a command of the user, from the button or from the console (request id,
+  CONSOLE_NO_ID for the button, with nargs numbers after the command)
+*******************************************************************************/
+static void run_command(int command, const uint16_t *argv, int nargs,
+                                                                uint16_t id){
+  uint8_t entry_type;
+  uint8_t args[STATESYNC_LEN];
+  int dest, queued;
+
+  if (!home_command_allowed(&state, command)){
+    //the alarm is active and the command is not "deactivate the alarm"
+    //the command has to be rejected
+    printf("Command rejected. Deactivate the alarm first.\n");
+    console_respond(id, "rejected");
+    return;
+  }
+
+  if (command == CONSOLE_CMD_MODULE){
+    //the nodes get the module from the CU and then from each other
+    console_respond(id, (loader_publish() < 0)?"empty":"ok");
+    return;
+  }
+
+  stats_app_begin(STATS_APP_COMMAND);
+  printf ("Command = %d.\n", command);
+
+  /*
+    the command is queued: if the connection is busy it waits for the
+    current transmission and then it is sent together with the other
+    pending commands for the same node
+  */
+  dest = home_command_route(command, &entry_type);
+  if (dest < 0){
+    printf("Error: command not recognized.\n");
+    console_respond(id, "unknown");
+  }
+  else if (command == MSG_CMD_TEMPERATURE || command == MSG_CMD_LIGHT)
+    //answered from the cache, the node is asked only if needed
+    read_sensor(entry_type, dest, id);
+  else{
+    if (home_apply(&state, command)){
+      /*
+        new version of the state (alarm, gate, extension): the frame makes
+        the nodes in range react at once, Trickle brings it to the ones that
+        miss it
+      */
+      statesync_changed();
+      statesync_encode(args);
+      queued = enqueue_command_args(dest, entry_type, args, STATESYNC_LEN);
+    }
+    else if (command == MSG_CMD_OPEN)
+      //the door and the gate start together, at the network time set when
+      //the frame is sent (see build_frame)
+      queued = enqueue_command(dest, entry_type);
+    else if (command == MSG_CMD_HISTORY){
+      //the window of the console, otherwise the node uses the last hour
+      if (nargs == 2){
+        msg_put_u16(args, argv[0]);
+        msg_put_u16(args + 2, argv[1]);
+        queued = enqueue_command_args(dest, entry_type, args, MSG_HISTORY_LEN);
+      }
+      else
+        queued = enqueue_command(dest, entry_type);
+
+      //answered by the reply of the node
+      if (queued >= 0 && console_wait(id, command, 
+                                              SENSORCACHE_REFRESH_TIMEOUT) == 0)
+        id = CONSOLE_NO_ID;
+    }
+    else
+      queued = enqueue_command(dest, entry_type);
+
+    console_respond(id, (queued < 0)?"busy":"ok");
+  }
+
+  stats_app_end(STATS_APP_COMMAND);
+}
+
 
 PROCESS_THREAD(handle_command_process, ev, data){
   static struct etimer et;
+  uint16_t argv[CONSOLE_MAX_ARGS];
+  uint8_t module[CONSOLE_MODULE_BYTES];
+  uint16_t id;
+  int nargs;
 
   /*
     triggered only when there is a PROCESS_EXIT event, in this case we don't 
@@ -107,15 +819,57 @@ PROCESS_THREAD(handle_command_process, ev, data){
 
   PROCESS_BEGIN();
 
+#if CU_CONF_RADIO_ALWAYS_ON
+  //the CU does not run on batteries: stop the duty cycle, keep the radio on
+  NETSTACK_MAC.off(1);
+#endif
+
+#if SCHEDULE_CONF_TIMESYNCH
+  //the network time is the one of the CU
+  timesynch_set_authority_level(0);
+#endif
+
+  load_epoch();
+  home_init(&state);
+  console_init();
+  sensorcache_init(&temperature_cache);
+  sensorcache_init(&light_cache);
+
   SENSORS_ACTIVATE(button_sensor);
 
   //we open the broadcastconnection. The second parameter is the channel on 
   //which the node will communicate. it is a sort of port
-  broadcast_open(&broadcast_extension_node, 128, &broadcast_call);
-  broadcast_open(&broadcast_regular_node, 129, &broadcast_call);
-  //open a runicast connection with Node2 (garden) over the channel 130
-  runicast_open(&runicast_node2,130, &runicast_calls); 
-  runicast_open(&runicast_node1,131, &runicast_calls); 
+  broadcast_open(&broadcast_extension_node, HOME_CHANNEL_EXTENSION, 
+                                                            &broadcast_call);
+  broadcast_open(&broadcast_regular_node, HOME_CHANNEL_REGULAR, 
+                                                            &broadcast_call);
+  //open a runicast connection with the garden nodes (Node2) and the door
+  //nodes (Node1)
+  runicast_open(&runicast_node2, HOME_CHANNEL_GATE, &runicast_calls); 
+  runicast_open(&runicast_node1, HOME_CHANNEL_DOOR, &runicast_calls); 
+#if TRANSPORT_CONF_MULTIHOP
+  //the CU is the root of the collect tree
+  transport_open(1, &transport_calls);
+#endif
+
+  //series uploaded by the nodes, a transfer per role at a time
+  bulk_open(&door_bulk, BULK_CHANNEL_DOOR, bulk_received);
+  bulk_open(&garden_bulk, BULK_CHANNEL_GARDEN, bulk_received);
+  //the CU is the source of the modules for the nodes
+  loader_open(1);
+
+  //the nodes learn the address of the CU, the CU the capabilities of the nodes
+  discovery_open(DISCOVERY_CAP_CU, node_found);
+  //the state of the house is shared with the nodes
+  statesync_open(&state, state_changed);
+
+  //the CU prints its own energy reports and the ones of the nodes
+  stats_start(NULL);
+
+#if SENSOR_CACHE_REFRESH_PERIOD
+  ctimer_set(&refresh_timer, CLOCK_SECOND*SENSOR_CACHE_REFRESH_PERIOD, 
+                                                      refresh_cache, NULL);
+#endif
 
   //display the available commands
   process_start(&display_process, NULL);
@@ -134,97 +888,32 @@ PROCESS_THREAD(handle_command_process, ev, data){
         etimer_restart(&et);
 
       button_pressed ++;
-    }else 
-      if (etimer_expired(&et)){
-        //4 seconds from the last press
-        if (alarm_state && button_pressed != 1){
-          //the alarm is active and the command is not "deactivate the alarm"
-          //the command has to be rejected
-          button_pressed = 0;
-          printf("Command rejected. Deactivate the alarm first.\n");
-        }
-        else if(!runicast_is_transmitting(&runicast_node2) && 
-            !runicast_is_transmitting(&runicast_node1) && button_pressed != 0){
-          command = button_pressed;
-          button_pressed = 0;
-          printf ("Command = %d.\n", command);
-
-          linkaddr_t recv;
-          packetbuf_copyfrom((void*)&command, sizeof(int));
-
-          switch(command){
-            case 1:
-              //activate/deactivate the alarm
-
-              //change the state of the alarm
-              alarm_state = (alarm_state == 0)?1:0;
-
-              //send the command in broadcast
-              broadcast_send(&broadcast_regular_node);
-
-              break;
-            case 2:
-              //sent a runicast message to node 2 so that the gate could be 
-              //opened/closed
-
-              //change the state of the gate
-              gate_locked = (gate_locked == 0)?1:0;
-            
-              //the receiver has rime address 2.0
-              recv.u8[0] = 2;
-              recv.u8[1] = 0;
-
-              //then we call the runicast send    
-              runicast_send(&runicast_node2, &recv, MAX_RETRANSMISSIONS);
-
-              break;
-            case 3:
-              //open and automatically close both the door and the gate
-              broadcast_send(&broadcast_regular_node);
-
-              break;
-            case 4:
-              //sent a runicast message to node 1 so that he compute the mean 
-              //temperature 
-            
-              //the receiver has rime address 1.0
-              recv.u8[0] = 1;
-              recv.u8[1] = 0;
-
-              //then we call the runicast send    
-              runicast_send(&runicast_node1, &recv, MAX_RETRANSMISSIONS);
-             
-              break;
-            case 5:
-              //node 2 sense (and send) the outer light
-
-              //the receiver has rime address 2.0 (Node 2)
-              recv.u8[0] = 2;
-              recv.u8[1] = 0;
-
-              //then we call the runicast send    
-              runicast_send(&runicast_node2, &recv, MAX_RETRANSMISSIONS);
-            
-              break;
-            case 6:
-              //the user activate the extension
-
-              //update the state 
-              extension_active = (extension_active)?0:1;
-              //send the command
-              broadcast_send(&broadcast_extension_node);
-
-              break;
-            default:
-              //
-                printf("Error: command not recognized.\n");
-
-            }
-          }
-
-          //display the available commands
-          process_start(&display_process, NULL);
+    }
+    else if (ev == serial_line_event_message && (nargs = 
+          console_parse_module((const char*)data, module)) != CONSOLE_NOT_MODULE)
+      //a piece of a module for the nodes
+      module_line(module, nargs);
+    else if (ev == serial_line_event_message){
+      //a request of the console, answered with its id (see console.h)
+      nargs = console_parse((const char*)data, &id, &command, argv);
+      if (nargs >= 0)
+        run_command(command, argv, nargs, id);
+      else if (id != CONSOLE_NO_ID)
+        console_respond(id, "malformed");
+      else
+        printf("RSP ? malformed\n");
+    }
+    else if (ev == PROCESS_EVENT_TIMER && data == &et){
+      //4 seconds from the last press
+      if (button_pressed != 0){
+        command = button_pressed;
+        button_pressed = 0;
+        run_command(command, NULL, 0, CONSOLE_NO_ID);
       }
+
+      //display the available commands
+      process_start(&display_process, NULL);
+    }
   }
 
   PROCESS_END();
@@ -234,24 +923,28 @@ PROCESS_THREAD(handle_command_process, ev, data){
 PROCESS_THREAD(display_process, ev, data){
   PROCESS_BEGIN();
 
-  if (alarm_state)
+  if (state.alarm_state)
     printf("1- Deactivate the alarm\n");
   else{
     printf("1- Activate the alarm\n");
 
-    if (gate_locked)
+    if (state.gate_locked)
       printf("2- Unlock the gate\n");
     else
       printf("2- Lock the gate\n");
 
     printf("3- Open (and automatically close) both the door and the gate in order to let a guest enter\n");
-    printf("4- Obtain the average of the last 5 temperature values\n");
+    printf("4- Obtain the average of the last %d temperature values\n", 
+                                                        TEMPERATURE_WINDOW);
     printf("5- Obtain the external light\n");
 
-    if (extension_active)
+    if (state.extension_active)
       printf("6- Deactivate the extension node\n");
     else
       printf("6- Activate the extension node\n");
+
+    printf("9- Obtain the temperature history of the last hour\n");
+    printf("10- Upload the temperature and light samples not sent yet\n");
   }
 
   PROCESS_END();
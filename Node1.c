@@ -6,21 +6,61 @@
 #include "dev/leds.h"
 #include "dev/sht11/sht11-sensor.h"
 #include "dev/button-sensor.h"
+#include "message.h"
+#include "sendqueue.h"
+#include "stats.h"
+#include "window.h"
+#include "home.h"
+#include "telemetry.h"
+#include "transport.h"
+#include "discovery.h"
+#include "groupack.h"
+#include "statesync.h"
+#include "dedup.h"
+#include "schedule.h"
+#include "history.h"
+#include "series.h"
+#include "bulk.h"
+#include "loader.h"
 
 
 #define MAX_RETRANSMISSIONS 5
 
-//unlocked (0) by default
-int alarm_state = 0;
+//alarm unlocked by default (see home.h), replicated by statesync
+static struct home_state state;
+//state the leds are showing
+static struct home_state applied;
 //off(0) by default
 int light_state = 0;
 int command = 0;
 int reject_locking = 0;
-int temperatures[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
-int temperature_index = 0;
+//the last TEMPERATURE_WINDOW samples, with their running mean/min/max
+WINDOW(temperatures, TEMPERATURE_WINDOW);
+//subscription of the CU to the mean temperature
+static struct telemetry temperature_sub;
 
 static unsigned char leds_status;
 
+//replies waiting for the runicast connection with the CU
+PACKETQUEUE(cu_packetqueue, SENDQUEUE_SIZE);
+static struct sendqueue cu_queue;
+//last group command of the CU (see groupack.h)
+static struct groupack_member group_member;
+//sequence numbers of the frames of the CU already executed
+static struct dedup cu_window;
+//the error report leaves after the recv callback
+static struct ctimer refusal_timer;
+//window of the last history request of the CU, answered after the callback
+static unsigned long history_from, history_to;
+static struct ctimer history_timer;
+//temperatures not uploaded yet to the CU, and their bulk transfer
+static struct series temperature_series;
+static struct bulk cu_bulk;
+static linkaddr_t cu_addr;
+static struct ctimer upload_timer;
+//the mean temperature is sent after the recv callback
+static struct ctimer temperature_timer;
+
 PROCESS(main_process, "Main process");
 PROCESS(blinking_process, "Blinking process");
 PROCESS(open_door, "Open the door");
@@ -30,42 +70,243 @@ PROCESS(compute_mean_temperateure, "Compute mean temperature");
 AUTOSTART_PROCESSES(&main_process, &temperature_process);
   
 
-static void broadcast_recv(struct broadcast_conn *c, const linkaddr_t *senderAddr){
-  printf("broadcast message received from %d.%d.\n", senderAddr->u8[0], 
-				senderAddr->u8[1]);
+/*******************************************************************************
+  tell the CU why the alarm has been switched off again
+*******************************************************************************/
+static void report_refusal(void *ptr){
+  msg_begin(MSG_OP_ERROR, 0);
+  msg_append_u8(MSG_TLV_ERROR, MSG_ERR_ALARM_REFUSED);
+  transport_send_to_cu(&cu_queue);
+}
 
-  //obtain the int command code from the message
-  command = *(int*)packetbuf_dataptr();
-  //printf("Received broadcast command = %d\n", command);
 
-  switch (command){
-    case 1:
-      //the leds have to start blinking or stop blinking, depending on the state
-      //of the alarm
+/*******************************************************************************
+  a new version of the state has been adopted: the leds have to start blinking
+  or stop blinking, depending on the state of the alarm. Return the status of
+  the command (MSG_ERR_* if refused)
+*******************************************************************************/
+static uint8_t apply_state(void){
+  uint8_t status = 0;
+
+  if (state.alarm_state == applied.alarm_state)
+    return 0;
+
+  if (state.alarm_state && reject_locking){
+    //the door is opening: the new version switches the alarm off everywhere
+    printf("Refuse to activate the alarm\n");
+    state.alarm_state = 0;
+    statesync_changed();
+
+    ctimer_set(&refusal_timer, 0, report_refusal, NULL);
+    status = MSG_ERR_ALARM_REFUSED;
+  }
+  else if (state.alarm_state)
+    //the user activates the alarm
+    process_start(&blinking_process, NULL);
+  else
+    //the user deactivate the alarm
+    process_exit(&blinking_process);
+
+  applied = state;
+
+  return status;
+}
+
+
+//state heard from a neighbour (see statesync.h)
+static void state_changed(void){
+  apply_state();
+}
+
+
+/*******************************************************************************
+  statistics of the temperature history in the window asked by the CU
+*******************************************************************************/
+static void report_history(void *ptr){
+  struct history_stats stats;
+  uint8_t buf[MSG_TLV_HISTORY_LEN];
+
+  stats_app_begin(STATS_APP_TEMPERATURE);
+  history_query(history_from, history_to, &stats);
+
+  printf("History %lu-%lu: %u samples, mean %d, min %d, max %d\n",
+      history_from, history_to, stats.count, stats.mean, stats.min, stats.max);
+
+  msg_put_u16(buf, stats.count);
+  msg_put_u16(buf + 2, stats.mean);
+  msg_put_u16(buf + 4, stats.min);
+  msg_put_u16(buf + 6, stats.max);
+
+  msg_begin(MSG_OP_REPLY, 0);
+  msg_append(MSG_TLV_HISTORY, buf, sizeof(buf));
+  transport_send_to_cu(&cu_queue);
+  stats_app_end(STATS_APP_TEMPERATURE);
+}
+
+
+/*******************************************************************************
+  the window of a HISTORY command, in minutes ago (the last hour by default)
+*******************************************************************************/
+static void ask_history(const struct msg_tlv *tlv){
+  unsigned long now = history_now();
+  unsigned long from = 60, to = 0;
+
+  if (tlv->len == MSG_HISTORY_LEN){
+    from = msg_get_u16(tlv->value);
+    to = msg_get_u16(tlv->value + 2);
+  }
+
+  history_from = (from*60 < now)?now - from*60:0;
+  history_to = (to*60 < now)?now - to*60:0;
+
+  ctimer_set(&history_timer, 0, report_history, NULL);
+}
+
+
+/*******************************************************************************
+  the temperatures not sent yet leave in a single block. Return -1 if the
+  transfer before is still in progress or the CU is not known yet
+*******************************************************************************/
+static int upload_series(void){
+  uint16_t len;
+
+  if (temperature_series.count == 0)
+    return 0;
+
+  len = series_encode(&temperature_series, clock_seconds());
+  if (bulk_send(&cu_bulk, &cu_addr, temperature_series.block, len) < 0)
+    return -1;
+
+  printf("Uploading %u temperatures in %u bytes\n", temperature_series.count,
+                                                                          len);
+  series_reset(&temperature_series);
+
+  return 0;
+}
+
+
+//upload asked by the CU, after the recv callback
+static void upload_requested(void *ptr){
+  if (upload_series() < 0)
+    printf("Upload not possible now\n");
+}
 
-      //update the state of the alarm
-      alarm_state = (alarm_state == 0)?1:0;
-    
-      //the user activates the alarm
-      if (alarm_state)
-        process_start(&blinking_process, NULL);
 
-      //the user deactivate the alarm
-      if (!alarm_state)
-        process_exit(&blinking_process);
+//mean temperature asked by the CU: the reply needs the packetbuf
+static void temperature_requested(void *ptr){
+  process_start(&compute_mean_temperateure, NULL);
+}
+
+
+//network time of the guest entry (see schedule.h)
+static void start_door(void){
+  process_start(&open_door, NULL);
+}
 
-      break;
-    case 3:
-      //open(and automatically close) both the door and the gate
 
-      //this is the node on the door: it waits for 14 seconds, then it blinks 
-      //for 16 second with a period of two seconds
-      process_start(&open_door, NULL);
+/*******************************************************************************
+  commands of the CU in the packetbuf, from the broadcast, the runicast or the
+  multi-hop transport
+*******************************************************************************/
+static void handle_commands(const linkaddr_t *from){
+  struct msg_reader reader;
+  struct msg_tlv tlv;
+  uint8_t status = 0;
+  int group = 0;
+
+  if (msg_open(&reader) < 0){
+    printf("Error: malformed message\n");
+    return;
+  }
 
-      break;
-    default:
-      printf("Error: command not recognized\n");
+  //a frame already executed: only the ack of a group command is sent again
+  if (reader.opcode == MSG_OP_COMMAND && !dedup_check(&cu_window, from,
+                                      msg_epoch(&reader), reader.seqno)){
+    while (msg_next(&reader, &tlv) > 0)
+      if (tlv.type == MSG_TLV_GROUP)
+        groupack_join(&group_member, &tlv, reader.seqno);
+    return;
   }
+
+  //every entry of the frame is a command code
+  while (msg_next(&reader, &tlv) > 0){
+    command = tlv.type;
+    //printf("Received command = %d\n", command);
+
+    switch (command){
+      case MSG_TLV_GROUP:
+        //a retransmission of a group command is only acknowledged again
+        if (!groupack_join(&group_member, &tlv, reader.seqno))
+          return;
+
+        group = 1;
+        break;
+      case MSG_TLV_STATE:
+        //a frame received twice, or after Trickle, carries an old version
+        if (statesync_recv(&tlv))
+          status = apply_state();
+
+        break;
+      case MSG_CMD_OPEN:
+        //open(and automatically close) both the door and the gate
+
+        //this is the node on the door: it waits for 14 seconds, then it blinks 
+        //for 16 second with a period of two seconds. Everything starts at the
+        //time chosen by the CU, together with the gate
+        if (tlv.len == MSG_OPEN_LEN)
+          schedule_at(msg_get_u16(tlv.value), start_door);
+        else
+          start_door();
+
+        break;
+      case MSG_CMD_TEMPERATURE:
+        //compute the mean temp and send it to the CU, once the frame is read
+        ctimer_set(&temperature_timer, 0, temperature_requested, NULL);
+
+        break;
+      case MSG_CMD_HISTORY:
+        //a window of the samples on the flash
+        ask_history(&tlv);
+
+        break;
+      case MSG_CMD_UPLOAD:
+        ctimer_set(&upload_timer, 0, upload_requested, NULL);
+
+        break;
+      case MSG_CMD_SUBSCRIBE:
+        //the mean temperature is pushed from the next sample on
+        if (tlv.len != MSG_SUBSCRIBE_LEN || tlv.value[0] != MSG_TLV_TEMPERATURE){
+          printf("Error: subscription not supported\n");
+          break;
+        }
+
+        telemetry_subscribe(&temperature_sub, msg_get_u16(tlv.value + 1),
+                                              msg_get_u16(tlv.value + 3));
+        break;
+      case MSG_CMD_UNSUBSCRIBE:
+        telemetry_unsubscribe(&temperature_sub);
+
+        break;
+      case MSG_TLV_EPOCH:
+        //already used by the duplicate check
+
+        break;
+      default:
+        printf("Error: command not recognized\n");
+    }
+  }
+
+  //ack (or nack) the group command to the CU
+  if (group)
+    groupack_done(&group_member, status);
+}
+
+
+static void broadcast_recv(struct broadcast_conn *c, const linkaddr_t *senderAddr){
+  printf("broadcast message received from %d.%d.\n", senderAddr->u8[0], 
+				senderAddr->u8[1]);
+
+  handle_commands(senderAddr);
 }
 
 
@@ -78,24 +319,16 @@ static void recv_runicast(struct runicast_conn *c, const linkaddr_t *sender_addr
   printf("runicast message received from %d.%d. Sequence number = %d\n", 
                     sender_addr->u8[0], sender_addr->u8[1], seqno);
 
-  command = *(int*)packetbuf_dataptr();
-  //printf("Received command = %d\n", command);
-
-  switch (command){
-    case 4:
-      //compute the mean temp and send it to the CU
-      process_start(&compute_mean_temperateure, NULL);
-
-      break;
-    default:
-      printf("Error: command not recognized\n");
-  }
+  handle_commands(sender_addr);
 }
 
 
 static void sent_runicast(struct runicast_conn *c, const linkaddr_t *receiver_addr, uint8_t retransmissions)
 {
   printf("runicast message sent to %d.%d, retransmissions %d\n", receiver_addr->u8[0], receiver_addr->u8[1], retransmissions);
+
+  //send the next queued reply, if any
+  sendqueue_sent(&cu_queue);
 }
 
 
@@ -106,8 +339,22 @@ static void timedout_runicast(struct runicast_conn *c, const linkaddr_t *receive
 {
   printf("runicast message timed out when sending to %d.%d, retransmissions %d\n", 
                          receiver_addr->u8[0], receiver_addr->u8[1], retransmissions);
+
+  sendqueue_sent(&cu_queue);
+}
+
+
+#if TRANSPORT_CONF_MULTIHOP
+static void recv_multihop(const linkaddr_t *from, uint8_t hops){
+  printf("multihop message received from %d.%d, %d hops\n", from->u8[0],
+                                                        from->u8[1], hops);
+
+  handle_commands(from);
 }
 
+static const struct transport_callbacks transport_calls = {recv_multihop, 
+                                                                      NULL};
+#endif
 
 //Be careful to the order
 static const struct broadcast_callbacks broadcast_call = {broadcast_recv, broadcast_sent}; 
@@ -116,6 +363,20 @@ static const struct runicast_callbacks runicast_calls = {recv_runicast, sent_run
 static struct runicast_conn runicast_CU;
 
 
+/*******************************************************************************
+  the replies and the energy reports go to the CU as soon as it is discovered
+*******************************************************************************/
+static void node_found(const linkaddr_t *addr, uint16_t caps){
+  if (!(caps & DISCOVERY_CAP_CU))
+    return;
+
+  printf("CU discovered: %d.%d\n", addr->u8[0], addr->u8[1]);
+  linkaddr_copy(&cu_addr, addr);
+  sendqueue_set_receiver(&cu_queue, addr);
+  stats_set_receiver(addr);
+}
+
+
 PROCESS_THREAD(main_process, ev, data){
   /*
     triggered only when there is a PROCESS_EXIT event, in this case we don't 
@@ -126,6 +387,9 @@ PROCESS_THREAD(main_process, ev, data){
 
   PROCESS_BEGIN();
 
+  home_init(&state);
+  applied = state;
+
   //at the beginning the lights are off
   leds_off(LEDS_GREEN);
   leds_on(LEDS_RED);
@@ -133,15 +397,33 @@ PROCESS_THREAD(main_process, ev, data){
   SENSORS_ACTIVATE(button_sensor);
 
   //we open the connection
-  broadcast_open(&broadcast, 129, &broadcast_call);
-  runicast_open(&runicast_CU, 131, &runicast_calls); //open our runicast connection over the channel #144
+  broadcast_open(&broadcast, HOME_CHANNEL_REGULAR, &broadcast_call);
+  runicast_open(&runicast_CU, HOME_CHANNEL_DOOR, &runicast_calls);
+#if TRANSPORT_CONF_MULTIHOP
+  transport_open(0, &transport_calls);
+#endif
+
+  //the address of the CU is not known yet: replies and energy reports wait
+  //for its discovery
+  sendqueue_init(&cu_queue, &runicast_CU, &cu_packetqueue, &linkaddr_null, 
+                                                          MAX_RETRANSMISSIONS);
+  groupack_member_init(&group_member, &cu_queue);
+  dedup_init(&cu_window);
+  bulk_open(&cu_bulk, BULK_CHANNEL_DOOR, NULL);
+  stats_start(&linkaddr_null);
+  stats_watch_queue(&cu_queue);
+  discovery_open(DISCOVERY_CAP_ALARM | DISCOVERY_CAP_DOOR |
+                                      DISCOVERY_CAP_TEMPERATURE, node_found);
+  statesync_open(&state, state_changed);
+  //modules disseminated by the CU (see loader.h)
+  loader_open(0);
 
   while(1) {
 
     PROCESS_WAIT_EVENT_UNTIL(ev==sensors_event && data==&button_sensor);
 
     //the alarm is not active
-    if (!alarm_state){
+    if (!state.alarm_state){
       //update the state of the lights
       light_state = (light_state)?0:1;
 
@@ -165,22 +447,6 @@ PROCESS_THREAD (blinking_process, ev, data){
 
   PROCESS_BEGIN();
 
-  if (reject_locking){
-    printf("Refuse to activate the alarm\n");
-    int error = 4031;
-    packetbuf_copyfrom((void*)&error, sizeof(int));
-    
-    //send the command in broadcast
-    broadcast_send(&broadcast);
-
-    //restore the status of the lock (unlocked)
-    alarm_state = 0;
-
-    PROCESS_EXIT();
-
-    break;
-  }
-
   //2 sec period: 1 sec on, 1 sec off
   etimer_set(&blinking_timer, CLOCK_SECOND);
 
@@ -194,11 +460,13 @@ PROCESS_THREAD (blinking_process, ev, data){
     PROCESS_WAIT_EVENT();
 
     //the timer is expired and the alarm is active
-    if (etimer_expired(&blinking_timer) && alarm_state){
+    if (etimer_expired(&blinking_timer) && state.alarm_state){
+      stats_app_begin(STATS_APP_ACTUATORS);
       //the timer expired: toggle every led
       leds_toggle(LEDS_ALL);
       //restart the timer
       etimer_reset(&blinking_timer);
+      stats_app_end(STATS_APP_ACTUATORS);
     }
 
     if (ev == PROCESS_EVENT_EXIT){
@@ -230,8 +498,10 @@ PROCESS_THREAD(open_door, ev, data){
   while(1){
     PROCESS_WAIT_EVENT();
     if (etimer_expired(&blink_door_timer)){
+      stats_app_begin(STATS_APP_ACTUATORS);
       leds_toggle(LEDS_BLUE);
       etimer_restart(&blink_door_timer);
+      stats_app_end(STATS_APP_ACTUATORS);
     }
 
     if (etimer_expired(&door_timer)){
@@ -246,22 +516,31 @@ PROCESS_THREAD(open_door, ev, data){
 
 /******************************************************************************* 
     every 10 seconds take a new temperature measurement.
-    The last 5 measurement are stored in the temperatures array
+    The last TEMPERATURE_WINDOW measurement are stored in the temperatures
+    window, that updates its statistics at every sample, and every sample is
+    logged in the history on the flash and in the series uploaded to the CU
+    when full. If the CU has subscribed, the new mean is pushed when it has
+    changed enough
 *******************************************************************************/
 PROCESS_THREAD(temperature_process, ev, data){
   static struct etimer temperature_timer;
+  int temp;
 
   PROCESS_BEGIN();
+  window_init(&temperatures);
+  history_init();
+  series_init(&temperature_series, MSG_TLV_TEMPERATURE, 10);
+  telemetry_init(&temperature_sub);
   etimer_set(&temperature_timer, CLOCK_SECOND*10);
 
   while(1){
     PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&temperature_timer));
+    stats_app_begin(STATS_APP_TEMPERATURE);
 
     //the sensor has to stay active for the minimum amount of time
     SENSORS_ACTIVATE(sht11_sensor);
     //actual (normalized) temp sample
-    temperatures[temperature_index%5]  = (
-                            sht11_sensor.value(SHT11_SENSOR_TEMP)/10-396)/10;
+    temp = (sht11_sensor.value(SHT11_SENSOR_TEMP)/10-396)/10;
     //stop the sensing phase
     SENSORS_DEACTIVATE(sht11_sensor);
 
@@ -271,48 +550,58 @@ PROCESS_THREAD(temperature_process, ev, data){
     //24° is the default value
     //RANDOM_MAX = 65535 -> random_rand()/6000 at most 10 values
     //             +/-5°(more or less)
-      temperatures[temperature_index%5] += (int)random_rand()/6000;
-
-    temperature_index++;
+    temp += (int)random_rand()/6000;
+
+    window_add(&temperatures, temp);
+    history_add(temp);
+
+    //a full series goes to the CU, or it is dropped if it cannot leave
+    if (series_add(&temperature_series, temp, clock_seconds()) < 0){
+      if (upload_series() < 0){
+        printf("Series of %u temperatures dropped\n",
+                                                  temperature_series.count);
+        series_reset(&temperature_series);
+      }
+      series_add(&temperature_series, temp, clock_seconds());
+    }
 
-    //printf("temperatures = {%d, %d, %d, %d, %d}\n", temperatures[0],
-    //        temperatures[1], temperatures[2], temperatures[3], temperatures[4]);
+    //push the mean to the CU if it has changed enough
+    temp = window_mean(&temperatures);
+    if (telemetry_due(&temperature_sub, temp)){
+      msg_begin(MSG_OP_PUSH, 0);
+      msg_append_int16(MSG_TLV_TEMPERATURE, temp);
+      transport_send_to_cu(&cu_queue);
+      telemetry_reported(&temperature_sub, temp);
+    }
+    stats_app_end(STATS_APP_TEMPERATURE);
   }
 
   PROCESS_END();
 }
 
 
+/******************************************************************************* 
+    the statistics are already up to date: the reply does not depend on the 
+    size of the window
+*******************************************************************************/
 PROCESS_THREAD(compute_mean_temperateure, ev, data){
-  int mean_temperature = 0;
-  int i;
+  int mean_temperature;
 
   PROCESS_BEGIN();
-    
-  for (i = 0; i<5; i++){
-    if (i<temperature_index){
-      mean_temperature += temperatures[i];
-    }
-  }
-
-  if (temperature_index<5)
-    mean_temperature /= temperature_index;
-  else
-    mean_temperature /= 5;
-
-  printf("mean_temperature %d\n", mean_temperature);
+  stats_app_begin(STATS_APP_TEMPERATURE);
 
-  if(!runicast_is_transmitting(&runicast_CU)){
-    linkaddr_t recv;
+  mean_temperature = window_mean(&temperatures);
 
-    //Central unit has rime address 3.0
-    recv.u8[0] = 3;
-    recv.u8[1] = 0;
+  printf("mean_temperature %d (%u samples, min %d, max %d, variance %lu)\n",
+      mean_temperature, window_count(&temperatures), 
+      window_min(&temperatures), window_max(&temperatures), 
+      window_variance(&temperatures));
 
-    packetbuf_copyfrom((void*)&mean_temperature, sizeof(int));
-    //send
-    runicast_send(&runicast_CU, &recv, MAX_RETRANSMISSIONS);
-  }
+  msg_begin(MSG_OP_REPLY, 0);
+  msg_append_int16(MSG_TLV_TEMPERATURE, mean_temperature);
+  //send (or queue, if the connection is busy)
+  transport_send_to_cu(&cu_queue);
 
+  stats_app_end(STATS_APP_TEMPERATURE);
   PROCESS_END();
 }
\ No newline at end of file
@@ -4,70 +4,224 @@
 #include "stdio.h"
 #include "dev/leds.h"
 #include "dev/light-sensor.h"
+#include "message.h"
+#include "sendqueue.h"
+#include "stats.h"
+#include "home.h"
+#include "telemetry.h"
+#include "transport.h"
+#include "discovery.h"
+#include "groupack.h"
+#include "statesync.h"
+#include "dedup.h"
+#include "schedule.h"
+#include "series.h"
+#include "bulk.h"
+#include "loader.h"
 
 #define MAX_RETRANSMISSIONS 5
+//period of the light samples pushed to a subscribed CU
+#define LIGHT_SAMPLE_PERIOD (CLOCK_SECOND*10)
 
-//unlocked (0) by default
-int alarm_state = 0;
-//the gate is locked by default
-int gate_locked = 1;
+//alarm unlocked and gate locked by default (see home.h), replicated by
+//statesync
+static struct home_state state;
+//state the leds are showing
+static struct home_state applied;
 
 static int command = 0;
 
+//subscription of the CU to the light
+static struct telemetry light_sub;
+
 static unsigned char leds_status;
 
+//replies waiting for the runicast connection with the CU
+PACKETQUEUE(cu_packetqueue, SENDQUEUE_SIZE);
+static struct sendqueue cu_queue;
+//last group command of the CU (see groupack.h)
+static struct groupack_member group_member;
+//sequence numbers of the frames of the CU already executed
+static struct dedup cu_window;
+//light samples not uploaded yet to the CU, and their bulk transfer
+static struct series light_series;
+static struct bulk cu_bulk;
+static linkaddr_t cu_addr;
+static struct ctimer upload_timer;
+//the light is sensed after the recv callback
+static struct ctimer light_timer;
+
 PROCESS(main_process, "Main process");
 PROCESS(blinking_process, "Blinking process");
 PROCESS(locking_gate, "Locks the gate");
 PROCESS(open_gate, "Open the gate");
 PROCESS(sensing_light, "sensing_light");
+PROCESS(light_sampler, "Light sampler");
 AUTOSTART_PROCESSES(&main_process);
   
 
+/*******************************************************************************
+  the light samples not sent yet leave in a single block. Return -1 if the
+  transfer before is still in progress or the CU is not known yet
+*******************************************************************************/
+static int upload_series(void){
+  uint16_t len;
+
+  if (light_series.count == 0)
+    return 0;
+
+  len = series_encode(&light_series, clock_seconds());
+  if (bulk_send(&cu_bulk, &cu_addr, light_series.block, len) < 0)
+    return -1;
+
+  printf("Uploading %u light samples in %u bytes\n", light_series.count, len);
+  series_reset(&light_series);
+
+  return 0;
+}
+
+
+//upload asked by the CU, after the recv callback
+static void upload_requested(void *ptr){
+  if (upload_series() < 0)
+    printf("Upload not possible now\n");
+}
+
+
+//light asked by the CU: the reply needs the packetbuf
+static void light_requested(void *ptr){
+  process_start(&sensing_light, NULL);
+}
+
+
+/*******************************************************************************
+  a new version of the state has been adopted: start or stop the alarm and
+  lock or unlock the gate
+*******************************************************************************/
+static void apply_state(void){
+  if (state.alarm_state != applied.alarm_state){
+    if (state.alarm_state)
+      process_start(&blinking_process, NULL);
+    else
+      process_exit(&blinking_process);
+  }
+
+  if (state.gate_locked != applied.gate_locked)
+    process_start(&locking_gate, NULL);
+
+  applied = state;
+}
+
+
+//network time of the guest entry (see schedule.h)
+static void start_gate(void){
+  process_start(&open_gate, NULL);
+}
+
+
+/*******************************************************************************
+  commands of the CU in the packetbuf, from the broadcast, the runicast or the
+  multi-hop transport
+*******************************************************************************/
+static void handle_commands(const linkaddr_t *from){
+  struct msg_reader reader;
+  struct msg_tlv tlv;
+  uint8_t status = 0;
+  int group = 0;
+
+  if (msg_open(&reader) < 0){
+    printf("Error: malformed message\n");
+    return;
+  }
+
+  //a frame already executed: only the ack of a group command is sent again
+  if (reader.opcode == MSG_OP_COMMAND && !dedup_check(&cu_window, from,
+                                      msg_epoch(&reader), reader.seqno)){
+    while (msg_next(&reader, &tlv) > 0)
+      if (tlv.type == MSG_TLV_GROUP)
+        groupack_join(&group_member, &tlv, reader.seqno);
+    return;
+  }
+
+  //every entry of the frame is a command code
+  while (msg_next(&reader, &tlv) > 0){
+    command = tlv.type;
+    //printf("Received command = %d\n", command);
+
+    switch (command){
+      case MSG_TLV_GROUP:
+        //a retransmission of a group command is only acknowledged again
+        if (!groupack_join(&group_member, &tlv, reader.seqno))
+          return;
+
+        group = 1;
+        break;
+      case MSG_TLV_STATE:
+        //the alarm or the gate have changed. An old version (a frame received
+        //twice, or after Trickle) is ignored
+        if (statesync_recv(&tlv))
+          apply_state();
+
+        break;
+      case MSG_CMD_OPEN:
+        //open(and automatically close) both the door and the gate
+
+        //this is the node on the gate. the blue led blinks for 16 seconds then 
+        //stops; from the time chosen by the CU, together with the door
+        if (tlv.len == MSG_OPEN_LEN)
+          schedule_at(msg_get_u16(tlv.value), start_gate);
+        else
+          start_gate();
+
+        break;
+      case MSG_CMD_LIGHT:
+        //Obtain the external light value and send it to the central unit,
+        //once the frame is read
+        ctimer_set(&light_timer, 0, light_requested, NULL);
+
+        break;
+      case MSG_CMD_SUBSCRIBE:
+        //the light is sampled periodically and pushed when it changes
+        if (tlv.len != MSG_SUBSCRIBE_LEN || tlv.value[0] != MSG_TLV_LIGHT){
+          printf("Error: subscription not supported\n");
+          break;
+        }
+
+        telemetry_subscribe(&light_sub, msg_get_u16(tlv.value + 1),
+                                        msg_get_u16(tlv.value + 3));
+        //nothing happens if the sampler is already running
+        process_start(&light_sampler, NULL);
+
+        break;
+      case MSG_CMD_UNSUBSCRIBE:
+        telemetry_unsubscribe(&light_sub);
+        process_exit(&light_sampler);
+
+        break;
+      case MSG_CMD_UPLOAD:
+        ctimer_set(&upload_timer, 0, upload_requested, NULL);
+
+        break;
+      case MSG_TLV_EPOCH:
+        //already used by the duplicate check
+
+        break;
+      default:
+        printf("Error: command not recognized\n");
+    }
+  }
+
+  //ack (or nack) the group command to the CU
+  if (group)
+    groupack_done(&group_member, status);
+}
+
+
 static void broadcast_recv(struct broadcast_conn *c, const linkaddr_t *senderAddr){
   printf("broadcast message received from %d.%d.\n", senderAddr->u8[0], 
 				senderAddr->u8[1]);
 
-  //obtain the int command code from the message
-  command = *(int*)packetbuf_dataptr();
-  //printf("Received command = %d\n", command);
-
-  switch (command){
-    case 1:
-      //the leds have to start blinking or stop blinking, depending on the state
-      //of the alarm
-
-      //update the state of the alarm
-      alarm_state = (alarm_state == 0)?1:0;
-      
-      //the user activates the alarm
-      if (alarm_state)
-        process_start(&blinking_process, NULL);
-
-      //the user deactivate the alarm
-      if (!alarm_state)
-        process_exit(&blinking_process);
-
-      break;
-    case 3:
-      //open(and automatically close) both the door and the gate
-
-      //this is the node on the gate. the blue led blinks for 16 seconds then 
-      //stops;
-      process_start(&open_gate, NULL);
-
-      break;
-    case 4031:
-      //node 1 refuse to activate the alarm
-      
-      //deactivate the alarm
-      process_exit(&blinking_process);
-      alarm_state = 0;
-      
-      break;
-    default:
-      printf("Error: command not recognized\n");
-  }
+  handle_commands(senderAddr);
 }
 
 
@@ -82,32 +236,15 @@ static void recv_runicast(struct runicast_conn *c, const linkaddr_t *sender_addr
   printf("runicast message received from %d.%d. Sequence number = %d\n", 
                     sender_addr->u8[0], sender_addr->u8[1], seqno);
 
-  command = *(int*)packetbuf_dataptr();
-  //printf("Received command = %d\n", command);
-
-  switch (command){
-    case 2:
-      //The CU asked to open/close the gate
-
-      //update the state of the gate
-      gate_locked = (gate_locked == 0)?1:0;
-
-      process_start(&locking_gate, NULL);
-
-      break;
-    case 5:
-      //Obtain the external light value and send it to the central unit
-      process_start(&sensing_light, NULL);
-
-      break;
-    default:
-      printf("Error: command not recognized\n");
-  }
+  handle_commands(sender_addr);
 }
 
 static void sent_runicast(struct runicast_conn *c, const linkaddr_t *receiver_addr, uint8_t retransmissions)
 {
   printf("runicast message sent to %d.%d, retransmissions %d\n", receiver_addr->u8[0], receiver_addr->u8[1], retransmissions);
+
+  //send the next queued reply, if any
+  sendqueue_sent(&cu_queue);
 }
 
 /*
@@ -117,8 +254,22 @@ static void timedout_runicast(struct runicast_conn *c, const linkaddr_t *receive
 {
   printf("runicast message timed out when sending to %d.%d, retransmissions %d\n", 
                          receiver_addr->u8[0], receiver_addr->u8[1], retransmissions);
+
+  sendqueue_sent(&cu_queue);
+}
+
+
+#if TRANSPORT_CONF_MULTIHOP
+static void recv_multihop(const linkaddr_t *from, uint8_t hops){
+  printf("multihop message received from %d.%d, %d hops\n", from->u8[0],
+                                                        from->u8[1], hops);
+
+  handle_commands(from);
 }
 
+static const struct transport_callbacks transport_calls = {recv_multihop, 
+                                                                      NULL};
+#endif
 
 //Be careful to the order
 static const struct broadcast_callbacks broadcast_call = {broadcast_recv, broadcast_sent}; 
@@ -128,6 +279,20 @@ static struct runicast_conn runicast_CU;
 
 
 
+/*******************************************************************************
+  the replies and the energy reports go to the CU as soon as it is discovered
+*******************************************************************************/
+static void node_found(const linkaddr_t *addr, uint16_t caps){
+  if (!(caps & DISCOVERY_CAP_CU))
+    return;
+
+  printf("CU discovered: %d.%d\n", addr->u8[0], addr->u8[1]);
+  linkaddr_copy(&cu_addr, addr);
+  sendqueue_set_receiver(&cu_queue, addr);
+  stats_set_receiver(addr);
+}
+
+
 PROCESS_THREAD(main_process, ev, data){
   /*
     triggered only when there is a PROCESS_EXIT event, in this case we don't require to keep
@@ -139,12 +304,36 @@ PROCESS_THREAD(main_process, ev, data){
 
   PROCESS_BEGIN();
 
+  home_init(&state);
+  applied = state;
+  telemetry_init(&light_sub);
+  series_init(&light_series, MSG_TLV_LIGHT, LIGHT_SAMPLE_PERIOD/CLOCK_SECOND);
+
   //we initialize the lock of the gate
   process_start(&locking_gate, NULL);
 
   //we open the connection
-  broadcast_open(&broadcast, 129, &broadcast_call);
-  runicast_open(&runicast_CU, 130, &runicast_calls); //open our runicast connection over the channel #144
+  broadcast_open(&broadcast, HOME_CHANNEL_REGULAR, &broadcast_call);
+  runicast_open(&runicast_CU, HOME_CHANNEL_GATE, &runicast_calls);
+#if TRANSPORT_CONF_MULTIHOP
+  transport_open(0, &transport_calls);
+#endif
+
+  //the address of the CU is not known yet: replies and energy reports wait
+  //for its discovery
+  sendqueue_init(&cu_queue, &runicast_CU, &cu_packetqueue, &linkaddr_null, 
+                                                          MAX_RETRANSMISSIONS);
+  groupack_member_init(&group_member, &cu_queue);
+  dedup_init(&cu_window);
+  bulk_open(&cu_bulk, BULK_CHANNEL_GARDEN, NULL);
+  stats_start(&linkaddr_null);
+  stats_watch_queue(&cu_queue);
+  discovery_open(DISCOVERY_CAP_ALARM | DISCOVERY_CAP_GATE |
+                                      DISCOVERY_CAP_LIGHT, node_found);
+  //the alarm refused by node 1.0 comes with its new version of the state
+  statesync_open(&state, apply_state);
+  //modules disseminated by the CU (see loader.h)
+  loader_open(0);
 
   while(1) {
 
@@ -172,13 +361,15 @@ PROCESS_THREAD (blinking_process, ev, data){
     
     PROCESS_WAIT_EVENT();
 
-    if (etimer_expired(&blinking_timer) && alarm_state){
+    if (etimer_expired(&blinking_timer) && state.alarm_state){
       //the timer is expired and the alarm is active
+      stats_app_begin(STATS_APP_ACTUATORS);
 
       //the timer expired: toggle every led
       leds_toggle(LEDS_ALL);
       //restart the timer
       etimer_reset(&blinking_timer);
+      stats_app_end(STATS_APP_ACTUATORS);
     }
 
     if (ev == PROCESS_EVENT_EXIT)
@@ -193,7 +384,7 @@ PROCESS_THREAD (blinking_process, ev, data){
 PROCESS_THREAD (locking_gate, ev, data){
   PROCESS_BEGIN();
 
-  if (gate_locked){
+  if (state.gate_locked){
     //we are locking the gate
     leds_off(LEDS_GREEN);
     leds_on(LEDS_RED);
@@ -225,8 +416,10 @@ PROCESS_THREAD(open_gate, ev, data){
   while(1){
     PROCESS_WAIT_EVENT();
     if (etimer_expired(&blink_gate_timer)){
+      stats_app_begin(STATS_APP_ACTUATORS);
       leds_toggle(LEDS_BLUE);
       etimer_restart(&blink_gate_timer);
+      stats_app_end(STATS_APP_ACTUATORS);
     }
 
     if (etimer_expired(&gate_timer)){
@@ -240,28 +433,81 @@ PROCESS_THREAD(open_gate, ev, data){
 }
 
 
-PROCESS_THREAD(sensing_light, ev, data){
-  PROCESS_BEGIN();
+/*******************************************************************************
+  normalized sample of light (lux)
+*******************************************************************************/
+static int sample_light(void){
+  int light;
 
   //sensing for the minimun amount of time
   SENSORS_ACTIVATE(light_sensor);
-  //normalized sample of light
-  int light = 10*light_sensor.value(LIGHT_SENSOR_PHOTOSYNTHETIC)/7;
-  printf("Sensed light %d lux\n", light);
+  light = 10*light_sensor.value(LIGHT_SENSOR_PHOTOSYNTHETIC)/7;
   SENSORS_DEACTIVATE(light_sensor);
 
+  return light;
+}
+
+
+PROCESS_THREAD(sensing_light, ev, data){
+  int light;
+
+  PROCESS_BEGIN();
+  stats_app_begin(STATS_APP_LIGHT);
+
+  light = sample_light();
+  printf("Sensed light %d lux\n", light);
+
   //transmit the light measurement to the CU
-  if(!runicast_is_transmitting(&runicast_CU)){
-    linkaddr_t recv;
+  msg_begin(MSG_OP_REPLY, 0);
+  msg_append_int16(MSG_TLV_LIGHT, light);
+  //the connection could be busy: in that case the reply waits in the queue
+  transport_send_to_cu(&cu_queue);
+
+  stats_app_end(STATS_APP_LIGHT);
+  PROCESS_END();
+}
 
-    //the receiver is the CU with rime addr 3.0
-    recv.u8[0] = 3;
-    recv.u8[1] = 0;
 
-    packetbuf_copyfrom((void*)&light, sizeof(int));
-    runicast_send(&runicast_CU, &recv, MAX_RETRANSMISSIONS);
+/*******************************************************************************
+  runs while the CU is subscribed: every LIGHT_SAMPLE_PERIOD takes a sample
+  and pushes it only if it has changed by the delta of the subscription (or
+  the max interval has elapsed). Every sample goes in the series uploaded to
+  the CU when full
+*******************************************************************************/
+PROCESS_THREAD(light_sampler, ev, data){
+  static struct etimer sample_timer;
+  int light;
+
+  PROCESS_BEGIN();
+
+  //started by the recv callback: the first push waits for the packetbuf
+  PROCESS_PAUSE();
+  etimer_set(&sample_timer, LIGHT_SAMPLE_PERIOD);
+
+  while(1){
+    stats_app_begin(STATS_APP_LIGHT);
+    light = sample_light();
+
+    if (telemetry_due(&light_sub, light)){
+      msg_begin(MSG_OP_PUSH, 0);
+      msg_append_int16(MSG_TLV_LIGHT, light);
+      transport_send_to_cu(&cu_queue);
+      telemetry_reported(&light_sub, light);
+    }
+
+    //a full series goes to the CU, or it is dropped if it cannot leave
+    if (series_add(&light_series, light, clock_seconds()) < 0){
+      if (upload_series() < 0){
+        printf("Series of %u light samples dropped\n", light_series.count);
+        series_reset(&light_series);
+      }
+      series_add(&light_series, light, clock_seconds());
+    }
+    stats_app_end(STATS_APP_LIGHT);
+
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&sample_timer));
+    etimer_reset(&sample_timer);
   }
 
   PROCESS_END();
 }
-
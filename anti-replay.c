@@ -0,0 +1,130 @@
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "stdio.h"
+#include "net/packetbuf.h"
+#include "net/mac/frame802154.h"
+#include "net/llsec/llsec802154.h"
+#include "net/llsec/anti-replay.h"
+
+/*******************************************************************************
+  Frame counter of the link-layer security, kept across a reboot. It takes
+  the place of core/net/llsec/anti-replay.c of Contiki (see the Makefile).
+
+  noncoresec remembers the last counter heard from every neighbour and never
+  forgets a neighbour. With the counter of Contiki, which starts again from 0
+  at every boot, a rebooted node (the CU above all) is deaf to the network
+  until its counter goes past the one of before the reboot: hours or days.
+
+  The counter is instead taken from a file on the flash. The file holds a
+  limit, ANTI_REPLAY_STEP frames ahead of the counter, written before the
+  counter reaches it: after a reboot the counter starts from the limit, past
+  every counter already sent, and the flash is written once every
+  ANTI_REPLAY_STEP frames instead of at every frame.
+*******************************************************************************/
+
+#define COUNTER_FILE "llsec"
+//frames sent between two writes of the flash, and counters skipped at a boot
+#define ANTI_REPLAY_STEP 256
+
+//counter of the last frame sent
+static uint32_t counter;
+//highest counter saved on the flash
+static uint32_t limit;
+static uint8_t loaded = 0;
+
+
+/*******************************************************************************
+  write the limit, little endian: the zero bytes that Coffee drops from the
+  end of a file (see history.c) are the high ones, read back as 0
+*******************************************************************************/
+static void save_limit(void){
+  uint8_t buf[4];
+  int fd;
+
+  buf[0] = limit & 0xff;
+  buf[1] = (limit >> 8) & 0xff;
+  buf[2] = (limit >> 16) & 0xff;
+  buf[3] = (limit >> 24) & 0xff;
+
+  cfs_remove(COUNTER_FILE);
+  fd = cfs_open(COUNTER_FILE, CFS_WRITE);
+  if (fd < 0 || cfs_write(fd, buf, sizeof(buf)) != sizeof(buf))
+    printf("Error: frame counter not saved, lost at the next boot\n");
+  if (fd >= 0)
+    cfs_close(fd);
+}
+
+
+static void load_counter(void){
+  uint8_t buf[4] = {0, 0, 0, 0};
+  int fd;
+
+  fd = cfs_open(COUNTER_FILE, CFS_READ);
+  if (fd >= 0){
+    cfs_read(fd, buf, sizeof(buf));
+    cfs_close(fd);
+  }
+
+  //the counters up to the limit may have been sent before the reboot
+  counter = (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) |
+            ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+  limit = counter + ANTI_REPLAY_STEP;
+  save_limit();
+
+  loaded = 1;
+}
+
+
+void anti_replay_set_counter(void){
+  frame802154_frame_counter_t reordered_counter;
+
+  if (!loaded)
+    load_counter();
+
+  //the flash is ahead of the frame on the air
+  if (++counter > limit){
+    limit = counter + ANTI_REPLAY_STEP;
+    save_limit();
+  }
+
+  reordered_counter.u32 = LLSEC802154_HTONL(counter);
+
+  packetbuf_set_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_0_1,
+                                                    reordered_counter.u16[0]);
+  packetbuf_set_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_2_3,
+                                                    reordered_counter.u16[1]);
+}
+
+
+/*******************************************************************************
+  receiver side, as in Contiki
+*******************************************************************************/
+uint32_t anti_replay_get_counter(void){
+  frame802154_frame_counter_t disordered_counter;
+
+  disordered_counter.u16[0] =
+                      packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_0_1);
+  disordered_counter.u16[1] =
+                      packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_2_3);
+
+  return LLSEC802154_HTONL(disordered_counter.u32);
+}
+
+
+void anti_replay_init_info(struct anti_replay_info *info){
+  info->last_broadcast_counter = info->last_unicast_counter =
+                                                    anti_replay_get_counter();
+}
+
+
+int anti_replay_was_replayed(struct anti_replay_info *info){
+  uint32_t received_counter = anti_replay_get_counter();
+  uint32_t *last = packetbuf_holds_broadcast()?
+                  &info->last_broadcast_counter:&info->last_unicast_counter;
+
+  if (received_counter <= *last)
+    return 1;
+
+  *last = received_counter;
+  return 0;
+}
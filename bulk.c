@@ -0,0 +1,113 @@
+#include "contiki.h"
+#include "stdio.h"
+#include <string.h>
+#include "bulk.h"
+#include "message.h"
+#include "transport.h"
+
+
+/*******************************************************************************
+  sender: copy the chunk at offset. A chunk shorter than maxsize is the last
+  one
+*******************************************************************************/
+static int read_chunk(struct rucb_conn *c, int offset, char *to, int maxsize){
+  struct bulk *b = (struct bulk*)c;
+  int len = (offset < b->len)?b->len - offset:0;
+
+  if (len > maxsize)
+    len = maxsize;
+  memcpy(to, b->data + offset, len);
+
+  if (len < maxsize)
+    b->sending = 0;
+
+  return len;
+}
+
+
+/*******************************************************************************
+  receiver: the chunks are copied in place, the block goes up with the last
+  one. A block too long, or with a gap (a chunk that does not follow the one
+  before, e.g. the rest of a transfer that timed out), is dropped; the
+  receiver of the block still checks its content (see series_check)
+*******************************************************************************/
+static void write_chunk(struct rucb_conn *c, int offset, int flag, char *data,
+                                                                    int len){
+  struct bulk *b = (struct bulk*)c;
+
+  if (flag == RUCB_FLAG_NEWFILE){
+    b->len = 0;
+    linkaddr_copy(&b->from, &c->sender);
+  }
+
+  if (offset + len > BULK_MAX_SIZE || offset > b->len){
+    b->len = BULK_MAX_SIZE + 1;
+    return;
+  }
+
+  if (len > 0 && b->len <= BULK_MAX_SIZE){
+    memcpy(b->data + offset, data, len);
+    b->len = offset + len;
+  }
+
+  if (flag != RUCB_FLAG_LASTCHUNK)
+    return;
+
+  if (b->len > BULK_MAX_SIZE)
+    printf("Bulk: block from %d.%d incomplete, dropped\n", b->from.u8[0],
+                                                              b->from.u8[1]);
+  else if (b->recv != NULL)
+    b->recv(&b->from, b->data, b->len);
+}
+
+
+static void timedout(struct rucb_conn *c){
+  struct bulk *b = (struct bulk*)c;
+
+  printf("Bulk: transfer to %d.%d timed out\n", c->receiver.u8[0],
+                                                          c->receiver.u8[1]);
+  b->sending = 0;
+}
+
+static const struct rucb_callbacks rucb_calls = {write_chunk, read_chunk,
+                                                                    timedout};
+
+
+void bulk_open(struct bulk *b, uint16_t channel, bulk_recv_t recv){
+  b->len = 0;
+  b->sending = 0;
+  b->recv = recv;
+  linkaddr_copy(&b->from, &linkaddr_null);
+
+  rucb_open(&b->c, channel, &rucb_calls);
+}
+
+
+int bulk_busy(struct bulk *b){
+  return b->sending || runicast_is_transmitting(&b->c.c);
+}
+
+
+int bulk_send(struct bulk *b, const linkaddr_t *cu, const uint8_t *data,
+                                                              uint16_t len){
+#if TRANSPORT_CONF_MULTIHOP
+  //a single frame over the collect tree
+  msg_begin(MSG_OP_PUSH, 0);
+  if (msg_append(MSG_TLV_SERIES, data, len) < 0)
+    return -1;
+
+  return transport_send_to_cu(NULL);
+#else
+  if (bulk_busy(b) || len > BULK_MAX_SIZE || linkaddr_cmp(cu, &linkaddr_null))
+    return -1;
+
+  memcpy(b->data, data, len);
+  b->len = len;
+  b->sending = 1;
+
+  //the chunks are read from the copy (read_chunk)
+  rucb_send(&b->c, cu);
+
+  return 0;
+#endif
+}
@@ -0,0 +1,58 @@
+#ifndef BULK_H_
+#define BULK_H_
+
+#include "contiki.h"
+#include "net/rime/rime.h"
+#include "net/rime/rucb.h"
+
+/*******************************************************************************
+  Bulk transfer of a block of data (a series, see series.h) from a node to the
+  CU.
+
+  The single hop transport sends the block with Rime rucb (reliable unicast
+  bulk): chunks of RUCB_DATASIZE bytes, each one acknowledged and sent again
+  until it is, the last one shorter than the others. The CU keeps a receiver
+  per role, on its own channel, because rucb takes the chunks of a single
+  sender at a time: the door and the garden nodes can upload together.
+
+  The multi-hop transport has no bulk transfer: the block travels in a single
+  frame (MSG_TLV_SERIES entry) over the collect tree, so it has to fit in a
+  frame (SERIES_SIZE in project-conf.h).
+*******************************************************************************/
+
+#define BULK_CHANNEL_DOOR   139
+#define BULK_CHANNEL_GARDEN 140
+
+//largest block
+#define BULK_MAX_SIZE 192
+
+//a whole block has been received from a node
+typedef void (*bulk_recv_t)(const linkaddr_t *from, const uint8_t *data,
+                                                                uint16_t len);
+
+struct bulk {
+  struct rucb_conn c;     //first: the callbacks of rucb get back the bulk
+  uint8_t data[BULK_MAX_SIZE];
+  uint16_t len;
+  uint8_t sending;
+  //receiver only
+  linkaddr_t from;
+  bulk_recv_t recv;
+};
+
+/*
+  open the transfers on channel. recv is NULL on the nodes
+*/
+void bulk_open(struct bulk *b, uint16_t channel, bulk_recv_t recv);
+
+/*
+  send a copy of the block to the CU (its address, with the single hop
+  transport). Return 0, -1 if a transfer is in progress, the block is too
+  long or the CU is not known yet
+*/
+int bulk_send(struct bulk *b, const linkaddr_t *cu, const uint8_t *data,
+                                                                uint16_t len);
+
+int bulk_busy(struct bulk *b);
+
+#endif /* BULK_H_ */
@@ -0,0 +1,67 @@
+#include "burst.h"
+
+
+void burst_init(struct burst *b){
+  b->next = 0;
+  b->count = 0;
+}
+
+
+void burst_add(struct burst *b, uint16_t sample){
+  b->samples[b->next] = sample;
+  b->next = (b->next + 1) & (BURST_SAMPLES - 1);
+
+  if (b->count < BURST_SAMPLES)
+    b->count++;
+}
+
+
+int burst_full(const struct burst *b){
+  return b->count == BURST_SAMPLES;
+}
+
+
+/*******************************************************************************
+  integer square root (the largest r with r*r <= value), bit by bit
+*******************************************************************************/
+static uint16_t isqrt(unsigned long value){
+  unsigned long root = 0;
+  unsigned long bit = 1UL << 30;
+
+  while (bit > value)
+    bit >>= 2;
+
+  while (bit != 0){
+    if (value >= root + bit){
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+      root >>= 1;
+    bit >>= 2;
+  }
+
+  return (uint16_t)root;
+}
+
+
+void burst_analyse(const struct burst *b, struct burst_level *level){
+  unsigned long sum_sq = 0;
+  uint16_t peak = 0;
+  uint8_t i;
+
+  if (b->count == 0){
+    level->rms = 0;
+    level->peak = 0;
+    return;
+  }
+
+  for (i = 0; i < b->count; i++){
+    sum_sq += (unsigned long)b->samples[i] * b->samples[i];
+    if (b->samples[i] > peak)
+      peak = b->samples[i];
+  }
+
+  level->rms = isqrt(sum_sq / b->count);
+  level->peak = peak;
+}
@@ -0,0 +1,42 @@
+#ifndef BURST_H_
+#define BURST_H_
+
+#include <stdint.h>
+
+/*******************************************************************************
+  Burst of ADC samples of the sound sensor, without any access to the sensor.
+
+  A single sample per second misses most of the sounds of a room. The
+  extension node takes instead BURST_SAMPLES samples at BURST_RATE Hz in a row
+  (64 ms), stores them in a ring buffer and reduces them to their RMS and
+  peak in one pass, then the CPU sleeps until the next burst.
+
+  The sums are kept on 32 bits: BURST_SAMPLES squares of 12 bits samples fit.
+*******************************************************************************/
+
+//power of two: the ring index is masked
+#define BURST_SAMPLES 64
+#define BURST_RATE 1000
+
+struct burst {
+  uint16_t samples[BURST_SAMPLES];
+  uint8_t next;         //slot of the next sample, the oldest one when full
+  uint8_t count;
+};
+
+struct burst_level {
+  uint16_t rms;
+  uint16_t peak;
+};
+
+void burst_init(struct burst *b);
+
+void burst_add(struct burst *b, uint16_t sample);
+
+//1 when BURST_SAMPLES samples have been taken since burst_init
+int burst_full(const struct burst *b);
+
+//RMS and peak of the samples
+void burst_analyse(const struct burst *b, struct burst_level *level);
+
+#endif /* BURST_H_ */
@@ -0,0 +1,210 @@
+#include "contiki.h"
+#include "stdio.h"
+#include "console.h"
+
+struct console_request {
+  uint16_t id;              //CONSOLE_NO_ID: free entry
+  uint8_t command;
+  unsigned long deadline;   //clock_seconds()
+};
+
+static struct console_request pending[CONSOLE_MAX_PENDING];
+static uint8_t pending_count;
+static struct ctimer timeout_timer;
+
+
+void console_init(void){
+  uint8_t i;
+
+  for (i = 0; i < CONSOLE_MAX_PENDING; i++)
+    pending[i].id = CONSOLE_NO_ID;
+  pending_count = 0;
+}
+
+
+/*******************************************************************************
+  decimal number at *pos, followed by a space or the end of the line
+*******************************************************************************/
+static int parse_number(const char **pos, unsigned long *value){
+  const char *p = *pos;
+
+  while (*p == ' ')
+    p++;
+
+  if (*p < '0' || *p > '9')
+    return -1;
+
+  *value = 0;
+  while (*p >= '0' && *p <= '9'){
+    *value = *value * 10 + (*p - '0');
+    //no more than 5 digits are needed
+    if (*value > 0xffff)
+      return -1;
+    p++;
+  }
+
+  if (*p != ' ' && *p != '\0')
+    return -1;
+
+  *pos = p;
+  return 0;
+}
+
+
+int console_parse(const char *line, uint16_t *id, int *command,
+                                                            uint16_t *args){
+  unsigned long value;
+  int count = 0;
+
+  *id = CONSOLE_NO_ID;
+
+  if (parse_number(&line, &value) < 0 || value == CONSOLE_NO_ID)
+    return -1;
+  *id = (uint16_t)value;
+
+  if (parse_number(&line, &value) < 0)
+    return -1;
+  *command = (int)value;
+
+  while (count < CONSOLE_MAX_ARGS && parse_number(&line, &value) == 0)
+    args[count++] = (uint16_t)value;
+
+  while (*line == ' ')
+    line++;
+
+  return (*line == '\0')?count:-1;
+}
+
+
+static int hex_digit(char c){
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+
+  return -1;
+}
+
+
+int console_parse_module(const char *line, uint8_t *data){
+  int count = 0, high, low;
+
+  if (line[0] != 'e' || line[1] != 'l' || line[2] != 'f' ||
+                                            (line[3] != ' ' && line[3] != '\0'))
+    return CONSOLE_NOT_MODULE;
+
+  line += 3;
+  while (*line == ' ')
+    line++;
+
+  while (*line != '\0' && *line != ' '){
+    high = hex_digit(line[0]);
+    low = (high < 0)?-1:hex_digit(line[1]);
+
+    if (low < 0 || count == CONSOLE_MODULE_BYTES)
+      return -1;
+
+    data[count++] = (high << 4) | low;
+    line += 2;
+  }
+
+  while (*line == ' ')
+    line++;
+
+  return (*line == '\0')?count:-1;
+}
+
+
+void console_respond_module(long size){
+  if (size >= 0)
+    printf("RSP elf %ld\n", size);
+  else
+    printf("RSP elf %s\n", (size == -1)?"malformed":"error");
+}
+
+
+void console_respond(uint16_t id, const char *status){
+  if (id == CONSOLE_NO_ID)
+    return;
+
+  printf("RSP %u %s\n", id, status);
+}
+
+
+void console_respond_value(uint16_t id, const char *name, int value,
+                                                          unsigned long age){
+  if (id == CONSOLE_NO_ID)
+    return;
+
+  printf("RSP %u %s %d %lu\n", id, name, value, age);
+}
+
+
+/*******************************************************************************
+  answer timeout to the requests past their deadline, check again every second
+  while some request is waiting
+*******************************************************************************/
+static void expire(void *ptr){
+  uint8_t i;
+
+  for (i = 0; i < CONSOLE_MAX_PENDING; i++)
+    if (pending[i].id != CONSOLE_NO_ID && 
+                                  clock_seconds() >= pending[i].deadline){
+      console_respond(pending[i].id, "timeout");
+      pending[i].id = CONSOLE_NO_ID;
+      pending_count--;
+    }
+
+  if (pending_count > 0)
+    ctimer_set(&timeout_timer, CLOCK_SECOND, expire, NULL);
+}
+
+
+int console_wait(uint16_t id, uint8_t command, unsigned long timeout){
+  uint8_t i;
+
+  if (id == CONSOLE_NO_ID)
+    return 0;
+
+  for (i = 0; i < CONSOLE_MAX_PENDING; i++)
+    if (pending[i].id == CONSOLE_NO_ID)
+      break;
+
+  if (i == CONSOLE_MAX_PENDING)
+    return -1;
+
+  pending[i].id = id;
+  pending[i].command = command;
+  pending[i].deadline = clock_seconds() + timeout;
+
+  if (pending_count++ == 0)
+    ctimer_set(&timeout_timer, CLOCK_SECOND, expire, NULL);
+
+  return 0;
+}
+
+
+void console_answer(uint8_t command, const char *name, int value){
+  uint8_t i;
+
+  for (i = 0; i < CONSOLE_MAX_PENDING && pending_count > 0; i++)
+    if (pending[i].id != CONSOLE_NO_ID && pending[i].command == command){
+      console_respond_value(pending[i].id, name, value, 0);
+      pending[i].id = CONSOLE_NO_ID;
+      pending_count--;
+    }
+}
+
+
+void console_answer_text(uint8_t command, const char *text){
+  uint8_t i;
+
+  for (i = 0; i < CONSOLE_MAX_PENDING && pending_count > 0; i++)
+    if (pending[i].id != CONSOLE_NO_ID && pending[i].command == command){
+      printf("RSP %u %s\n", pending[i].id, text);
+      pending[i].id = CONSOLE_NO_ID;
+      pending_count--;
+    }
+}
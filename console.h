@@ -0,0 +1,96 @@
+#ifndef CONSOLE_H_
+#define CONSOLE_H_
+
+#include "contiki.h"
+
+/*******************************************************************************
+  Command console of the CU on the serial line.
+
+  The button accepts a command every 4 seconds at most. The console accepts a
+  request per line, any number of them in a row without waiting for the
+  answers (pipelining): each request has an id chosen by the client, and its
+  response carries the same id, in the order the results are ready.
+
+    request:   <id> <command> [<arg> ...]
+    response:  RSP <id> <status> [<value> <age>]
+
+  id is a decimal number in 0..65534, command the number of the menu of the
+  CU (MSG_CMD_*), followed by up to CONSOLE_MAX_ARGS numbers (the window of
+  the history, in minutes ago). The status is:
+    ok            the command has been queued for the nodes
+    rejected      not allowed in the current state (the alarm is active)
+    busy          too many commands waiting for the radio, retry later
+    unknown       no such command
+    malformed     the line is not a request (the id is ? if missing)
+    temperature   a reading, with its value and its age in seconds
+    light
+    history       the statistics of the temperature history: samples, mean,
+                  min and max
+    timeout       the node has not answered the reading in time
+    empty         there is no module to disseminate
+  A reading in the cache of the CU is answered at once, otherwise when the
+  node answers. The debug output of the CU shares the serial line: a client
+  reads only the lines that start with RSP.
+
+  A module for the nodes (see loader.h) comes on the same line, in hex, a line
+  at a time (wait for the response before the next one):
+    elf             start a new module
+    elf <hex>       append up to CONSOLE_MODULE_BYTES bytes to it
+    response:       RSP elf <size of the module>, or RSP elf malformed/error
+  then the request <id> CONSOLE_CMD_MODULE disseminates it.
+*******************************************************************************/
+
+#define CONSOLE_NO_ID 0xffff
+#define CONSOLE_MAX_ARGS 2
+
+//command of the CU only: disseminate the module received (see loader.h)
+#define CONSOLE_CMD_MODULE 11
+//bytes of a module line, within the 80 characters of the serial line
+#define CONSOLE_MODULE_BYTES 32
+#define CONSOLE_NOT_MODULE (-2)
+
+//max readings waiting for the answer of a node
+#ifndef CONSOLE_MAX_PENDING
+#define CONSOLE_MAX_PENDING 8
+#endif
+
+void console_init(void);
+
+/*
+  parse a request line, args has room for CONSOLE_MAX_ARGS numbers. Return
+  the number of args, -1 if the line is malformed (id is set to CONSOLE_NO_ID
+  if it could not be read)
+*/
+int console_parse(const char *line, uint16_t *id, int *command,
+                                                              uint16_t *args);
+
+/*
+  response to the request id. Nothing is printed for CONSOLE_NO_ID (the
+  command came from the button)
+*/
+void console_respond(uint16_t id, const char *status);
+void console_respond_value(uint16_t id, const char *name, int value,
+                                                          unsigned long age);
+
+/*
+  the request id waits for a reading of command (MSG_CMD_TEMPERATURE/LIGHT/
+  HISTORY): it is answered by console_answer(_text), or with a timeout after timeout seconds.
+  Return -1 if too many requests are waiting
+*/
+int console_wait(uint16_t id, uint8_t command, unsigned long timeout);
+
+/*
+  parse a module line in data (CONSOLE_MODULE_BYTES). Return the number of
+  bytes, -1 if the line is malformed, CONSOLE_NOT_MODULE if it is a request
+*/
+int console_parse_module(const char *line, uint8_t *data);
+
+//response to a module line: the size of the module, -1 malformed, -2 error
+void console_respond_module(long size);
+
+//a new reading of command: answer the requests waiting for it
+void console_answer(uint8_t command, const char *name, int value);
+//same, with the rest of the response line already formatted
+void console_answer_text(uint8_t command, const char *text);
+
+#endif /* CONSOLE_H_ */
@@ -0,0 +1,77 @@
+#include "decibel.h"
+
+#if DECIBEL_CONF_FIXED_POINT
+
+/*
+  db_threshold[d] is the smallest integer value v such that 20*log10(v) >= d,
+  that is ceil(10^(d/20)). It covers every value of 16 bits (96 dB)
+*/
+static const unsigned int db_threshold[] = {
+      1,     2,     2,     2,     2,     2,     2,     3,     3,     3,
+      4,     4,     4,     5,     6,     6,     7,     8,     8,     9,
+     10,    12,    13,    15,    16,    18,    20,    23,    26,    29,
+     32,    36,    40,    45,    51,    57,    64,    71,    80,    90,
+    100,   113,   126,   142,   159,   178,   200,   224,   252,   282,
+    317,   355,   399,   447,   502,   563,   631,   708,   795,   892,
+   1000,  1123,  1259,  1413,  1585,  1779,  1996,  2239,  2512,  2819,
+   3163,  3549,  3982,  4467,  5012,  5624,  6310,  7080,  7944,  8913,
+  10000, 11221, 12590, 14126, 15849, 17783, 19953, 22388, 25119, 28184,
+  31623, 35482, 39811, 44669, 50119, 56235, 63096
+};
+#define DB_MAX (sizeof(db_threshold)/sizeof(db_threshold[0]) - 1)
+
+
+int decibel_adc_to_mv(int adc){
+  /*
+    adc * 3300/4096 (battery ref value typical when connected over USB)
+        * 5000/3000 (internal voltage divider for the 5V phidget, 5:3)
+    = adc * 1375/1024, exact with a 32 bits product
+  */
+  return (int)(((long)adc * 1375) >> 10);
+}
+
+
+int decibel_from_mv(int mv){
+  unsigned int low = 0, high = DB_MAX, mid;
+
+  if (mv < 1)
+    return 0;
+
+  //largest d with db_threshold[d] <= mv
+  while (low < high){
+    mid = (low + high + 1) / 2;
+
+    if (db_threshold[mid] <= (unsigned int)mv)
+      low = mid;
+    else
+      high = mid - 1;
+  }
+
+  return (int)low;
+}
+
+#else /* DECIBEL_CONF_FIXED_POINT */
+
+#include "math.h"
+
+int decibel_adc_to_mv(int adc){
+  double aux = adc;
+
+  aux *= 3300;  // battery ref value typical when connected over USB
+  aux /= 4096;
+  aux *= 5000;  //External voltage reference as
+  aux /= 3000;  //internal voltage divider for the 5V phidget (ADC0,
+                //ADC3) has 5:3 relationship
+
+  return (int)aux;
+}
+
+
+int decibel_from_mv(int mv){
+  if (mv < 1)
+    return 0;
+
+  return 20 * log10f((double)mv);
+}
+
+#endif /* DECIBEL_CONF_FIXED_POINT */
@@ -0,0 +1,29 @@
+#ifndef DECIBEL_H_
+#define DECIBEL_H_
+
+/*******************************************************************************
+  Conversion of the 5V phidget (sound sensor) ADC samples to dB.
+
+  With DECIBEL_CONF_FIXED_POINT (default) the conversion uses only integer
+  operations and a lookup table for log10: the MSP430 has no FPU and the soft
+  float multiplications/divisions and log10f cost thousands of cycles for each
+  sample. Set it to 0 (make FIXED_POINT=0) to go back to the floating point
+  version, which needs -lm.
+*******************************************************************************/
+
+#ifndef DECIBEL_CONF_FIXED_POINT
+#define DECIBEL_CONF_FIXED_POINT 1
+#endif
+
+/*
+  convert a 12 bits ADC sample of the 5V phidget in mV
+*/
+int decibel_adc_to_mv(int adc);
+
+/*
+  20*log10(value), truncated to an integer as (int)(20*log10f(value)) does.
+  Values lower than 1 give 0
+*/
+int decibel_from_mv(int mv);
+
+#endif /* DECIBEL_H_ */
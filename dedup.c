@@ -0,0 +1,62 @@
+#include "contiki.h"
+#include "dedup.h"
+
+
+void dedup_init(struct dedup *d){
+  uint8_t i;
+
+  for (i = 0; i < DEDUP_MAX_SENDERS; i++)
+    d->senders[i].valid = 0;
+  d->next = 0;
+}
+
+
+static struct dedup_sender *find(struct dedup *d, const linkaddr_t *from){
+  struct dedup_sender *s;
+  uint8_t i;
+
+  for (i = 0; i < DEDUP_MAX_SENDERS; i++)
+    if (d->senders[i].valid && linkaddr_cmp(&d->senders[i].addr, from))
+      return &d->senders[i];
+
+  //a new sender takes the place of the oldest one
+  s = &d->senders[d->next];
+  d->next = (d->next + 1) % DEDUP_MAX_SENDERS;
+  s->valid = 0;
+  linkaddr_copy(&s->addr, from);
+
+  return s;
+}
+
+
+int dedup_check(struct dedup *d, const linkaddr_t *from, uint16_t epoch,
+                                                              uint8_t seqno){
+  struct dedup_sender *s = find(d, from);
+  //the sequence number wraps around at 256
+  int8_t diff = (int8_t)(seqno - s->last);
+
+  if (!s->valid || epoch != s->epoch || diff <= -DEDUP_WINDOW){
+    //first frame of the sender, or the sender has rebooted and restarted its
+    //counter
+    s->valid = 1;
+    s->epoch = epoch;
+    s->last = seqno;
+    s->bitmap = 1;
+    return 1;
+  }
+
+  if (diff > 0){
+    //newer than every frame seen: slide the window
+    s->bitmap = (diff >= DEDUP_WINDOW)?0:(uint16_t)(s->bitmap << diff);
+    s->bitmap |= 1;
+    s->last = seqno;
+    return 1;
+  }
+
+  //inside the window: late, or already received
+  if (s->bitmap & (1U << -diff))
+    return 0;
+
+  s->bitmap |= 1U << -diff;
+  return 1;
+}
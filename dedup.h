@@ -0,0 +1,62 @@
+#ifndef DEDUP_H_
+#define DEDUP_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+
+/*******************************************************************************
+  Duplicate suppression of the frames received, by sequence number.
+
+  For each sender the node remembers the highest sequence number seen and a
+  bitmap of the DEDUP_WINDOW numbers before it, like the anti-replay window of
+  IPsec: a frame already in the window is a duplicate (a broadcast repeated by
+  the CU, a retransmission whose ack was lost) and must not be executed again.
+  A frame older than the window is accepted and restarts it, since the sender
+  has most likely rebooted and restarted its counter.
+
+  A sender that reboots after less than DEDUP_WINDOW frames restarts its
+  counter inside the window, where the new frames would look like duplicates.
+  Every command of the CU carries its boot counter (MSG_TLV_EPOCH, see
+  msg_epoch): another epoch restarts the window whatever the sequence number.
+  Any change counts, not only an increase, so a CU whose flash has been
+  erased, and counts from 1 again, is not locked out.
+
+  Only the commands (MSG_OP_COMMAND) are checked: they have their own sequence
+  numbers on the CU (see msg_begin), so the other frames of the CU never make
+  them wrap around into the window.
+
+  The state commands are idempotent anyway (see statesync.h): the window 
+  protects the ones with a side effect, such as opening the door or answering
+  a reading, so the CU can repeat its frames without any risk.
+*******************************************************************************/
+
+//bits of the window
+#define DEDUP_WINDOW 16
+
+#ifndef DEDUP_MAX_SENDERS
+#define DEDUP_MAX_SENDERS 2
+#endif
+
+struct dedup_sender {
+  linkaddr_t addr;
+  uint8_t valid;
+  uint16_t epoch;           //boot counter of the sender, 0 if unknown
+  uint8_t last;             //highest sequence number received
+  uint16_t bitmap;          //bit i: last - i has been received
+};
+
+struct dedup {
+  struct dedup_sender senders[DEDUP_MAX_SENDERS];
+  uint8_t next;             //entry replaced when a new sender shows up
+};
+
+void dedup_init(struct dedup *d);
+
+/*
+  return 1 if the frame seqno of from, sent in the boot epoch of the sender,
+  is new (and remember it), 0 if it is a duplicate
+*/
+int dedup_check(struct dedup *d, const linkaddr_t *from, uint16_t epoch,
+                                                              uint8_t seqno);
+
+#endif /* DEDUP_H_ */
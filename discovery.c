@@ -0,0 +1,160 @@
+#include "contiki.h"
+#include "net/rime/rime.h"
+#include "net/rime/announcement.h"
+#include "stdio.h"
+#include "discovery.h"
+#if TRANSPORT_CONF_MULTIHOP
+#include "lib/random.h"
+#include "message.h"
+#include "transport.h"
+#endif
+
+struct discovery_node {
+  linkaddr_t addr;
+  uint16_t caps;              //0: free entry
+  unsigned long last_seen;    //clock_seconds()
+};
+
+static struct discovery_node nodes[DISCOVERY_MAX_NODES];
+static struct announcement announcement;
+static discovery_callback_t found_callback;
+#if TRANSPORT_CONF_MULTIHOP
+static uint16_t own_caps;
+static struct ctimer refresh_timer;
+#endif
+
+
+/*******************************************************************************
+  free the entries not refreshed for DISCOVERY_TIMEOUT seconds
+*******************************************************************************/
+static void expire(void){
+  uint8_t i;
+
+  for (i = 0; i < DISCOVERY_MAX_NODES; i++)
+    if (nodes[i].caps != 0 &&
+              clock_seconds() - nodes[i].last_seen > DISCOVERY_TIMEOUT){
+      printf("Node %d.%d lost\n", nodes[i].addr.u8[0], nodes[i].addr.u8[1]);
+      nodes[i].caps = 0;
+    }
+}
+
+
+/*******************************************************************************
+  the node from has the capabilities value: add or refresh its entry
+*******************************************************************************/
+static void learn(const linkaddr_t *from, uint16_t value){
+  struct discovery_node *slot = NULL;
+  uint8_t i;
+
+  expire();
+
+  for (i = 0; i < DISCOVERY_MAX_NODES; i++){
+    if (nodes[i].caps != 0 && linkaddr_cmp(&nodes[i].addr, from)){
+      nodes[i].last_seen = clock_seconds();
+      if (nodes[i].caps != value){
+        nodes[i].caps = value;
+        found_callback(from, value);
+      }
+      return;
+    }
+
+    if (nodes[i].caps == 0 && slot == NULL)
+      slot = &nodes[i];
+  }
+
+  if (slot == NULL){
+    printf("Discovery table full: node %d.%d ignored\n", from->u8[0],
+                                                                from->u8[1]);
+    return;
+  }
+
+  linkaddr_copy(&slot->addr, from);
+  slot->caps = value;
+  slot->last_seen = clock_seconds();
+  found_callback(from, value);
+}
+
+
+static void heard(struct announcement *a, const linkaddr_t *from, uint16_t id,
+                                                              uint16_t value){
+  if (id != DISCOVERY_ANNOUNCEMENT_ID || value == 0)
+    return;
+
+  learn(from, value);
+}
+
+
+#if TRANSPORT_CONF_MULTIHOP
+/*******************************************************************************
+  the capabilities of the node to the CU, along the collect tree
+*******************************************************************************/
+static void refresh(void *ptr){
+  uint8_t buf[2];
+
+  msg_put_u16(buf, own_caps);
+  msg_begin(MSG_OP_ANNOUNCE, 0);
+  msg_append(MSG_TLV_CAPS, buf, sizeof(buf));
+  transport_send_to_cu(NULL);
+
+  ctimer_set(&refresh_timer, DISCOVERY_REFRESH * CLOCK_SECOND, refresh, NULL);
+}
+
+
+void discovery_recv(const linkaddr_t *from){
+  struct msg_reader reader;
+  struct msg_tlv tlv;
+
+  if (msg_open(&reader) < 0 || reader.opcode != MSG_OP_ANNOUNCE)
+    return;
+
+  while (msg_next(&reader, &tlv) > 0)
+    if (tlv.type == MSG_TLV_CAPS && tlv.len == 2 &&
+                                                  msg_get_u16(tlv.value) != 0)
+      learn(from, msg_get_u16(tlv.value));
+}
+#endif
+
+
+void discovery_open(uint16_t caps, discovery_callback_t found){
+  found_callback = found;
+
+  announcement_register(&announcement, DISCOVERY_ANNOUNCEMENT_ID, heard);
+  announcement_set_value(&announcement, caps);
+  //advertise at once and ask the neighbours to do the same
+  announcement_bump(&announcement);
+  announcement_listen(1);
+
+#if TRANSPORT_CONF_MULTIHOP
+  //the CU is the sink of the tree: it learns the others
+  own_caps = caps;
+  if (!(caps & DISCOVERY_CAP_CU))
+    //not every node at once after a reset of the network
+    ctimer_set(&refresh_timer, random_rand() % (CLOCK_SECOND * 8), refresh,
+                                                                        NULL);
+#endif
+}
+
+
+const linkaddr_t *discovery_next(uint16_t cap, uint8_t *index){
+  expire();
+
+  for (; *index < DISCOVERY_MAX_NODES; (*index)++)
+    if (nodes[*index].caps & cap)
+      return &nodes[(*index)++].addr;
+
+  return NULL;
+}
+
+
+int discovery_count(uint16_t cap){
+  uint8_t i;
+  int count = 0;
+
+  expire();
+
+  for (i = 0; i < DISCOVERY_MAX_NODES; i++)
+    if (nodes[i].caps & cap)
+      count++;
+
+  return count;
+}
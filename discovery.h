@@ -0,0 +1,72 @@
+#ifndef DISCOVERY_H_
+#define DISCOVERY_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+
+/*******************************************************************************
+  Service discovery.
+
+  Every node, and the CU, advertises its capabilities (DISCOVERY_CAP_*) with a
+  Rime announcement: the value of the announcement is the bitmask of the
+  capabilities, piggybacked on the announcements that Rime already sends. The
+  nodes heard are kept in a table, so that:
+    - the CU sends a command to every node with the capability needed, instead
+      of the hard-coded addresses 1.0 and 2.0
+    - the nodes learn the address of the CU instead of assuming 3.0
+  An entry not refreshed for DISCOVERY_TIMEOUT seconds is removed: the polite
+  announcements are sent at most every 128 seconds once the network is stable.
+
+  The announcements reach the neighbours only. With the multi-hop transport
+  every node also sends its capabilities to the CU along the collect tree
+  (MSG_OP_ANNOUNCE) every DISCOVERY_REFRESH seconds, so the CU knows the nodes
+  several hops away too. The table has an entry for every node of the network
+  (NETWORK_CONF_SIZE, see project-conf.h).
+*******************************************************************************/
+
+#define DISCOVERY_ANNOUNCEMENT_ID 140
+
+//capabilities
+#define DISCOVERY_CAP_CU          0x0001
+#define DISCOVERY_CAP_ALARM       0x0002  //leds of the alarm (regular nodes)
+#define DISCOVERY_CAP_TEMPERATURE 0x0004
+#define DISCOVERY_CAP_LIGHT       0x0008
+#define DISCOVERY_CAP_GATE        0x0010
+#define DISCOVERY_CAP_DOOR        0x0020
+#define DISCOVERY_CAP_PRESENCE    0x0040  //extension node
+
+//every node of the network and the CU
+#ifndef DISCOVERY_MAX_NODES
+#define DISCOVERY_MAX_NODES (NETWORK_CONF_SIZE + 1)
+#endif
+
+#define DISCOVERY_TIMEOUT 400
+//a few refreshes may be lost before the CU forgets a node
+#define DISCOVERY_REFRESH (DISCOVERY_TIMEOUT / 4)
+
+/*
+  called when a node is heard for the first time or changes its capabilities
+*/
+typedef void (*discovery_callback_t)(const linkaddr_t *addr, uint16_t caps);
+
+/*
+  advertise the capabilities of this node and start listening to the others
+*/
+void discovery_open(uint16_t caps, discovery_callback_t found);
+
+/*
+  CU only, multi-hop transport: learn the node that sent the MSG_OP_ANNOUNCE
+  frame in the packetbuf
+*/
+void discovery_recv(const linkaddr_t *from);
+
+/*
+  iterate over the nodes with the capability cap: index starts from 0 and is
+  advanced past the node returned. Return NULL when there are no more nodes
+*/
+const linkaddr_t *discovery_next(uint16_t cap, uint8_t *index);
+
+//number of nodes with the capability cap
+int discovery_count(uint16_t cap);
+
+#endif /* DISCOVERY_H_ */
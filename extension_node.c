@@ -5,74 +5,310 @@
 #include "dev/leds.h"
 #include "dev/z1-phidgets.h"
 #include "sys/etimer.h"
-#include "math.h"
 #include "net/rime/rime.h"
 #include "dev/light-sensor.h"
 #include "core/lib/random.h"
-
-
-#define SAMPLE_TO_DEACTIVATE 120
-#define SAMPLE_TO_ACTIVATE 30
-
-//extension off by default(0)
-static int extension_active = 0;
-int sample_noise = 0;
-int sample_silence = 0;
+#include "message.h"
+#include "stats.h"
+#include "decibel.h"
+#include "burst.h"
+#include "home.h"
+#include "presence.h"
+#include "transport.h"
+#include "discovery.h"
+#include "statesync.h"
+#include "dedup.h"
+#include "loader.h"
+
+
+//extension off by default (see home.h), replicated by statesync
+static struct home_state state;
+//state the sensing is following
+static struct home_state applied;
+//presence detection (see presence.h)
+static struct presence room;
+//sequence numbers of the frames of the CU already executed
+static struct dedup cu_window;
 static int temperature = 20;
-int human_sensed = 0;
 int sample_to_be_activated = -1;
 
+//posted to the temperature monitoring when the user changes the temperature
+static process_event_t setpoint_changed_event;
+
+#if SENSING_CONF_BURST
+//samples of the last burst of the sound sensor (see burst.h)
+static struct burst sound;
+#define BURST_PERIOD (RTIMER_SECOND/BURST_RATE)
+#if SENSING_CONF_RTIMER
+static struct rtimer burst_rtimer;
+#endif
+#endif
+
 /*---------------------------------------------------------------------------*/
 PROCESS(sensing_process, "Test Button & ADC");
 PROCESS(temperature_monitoring_process, "Temperature monitoring process");
 PROCESS(main_process, "Main process");
 AUTOSTART_PROCESSES(&main_process);
 /*---------------------------------------------------------------------------*/
-static void broadcast_recv(struct broadcast_conn *c, const linkaddr_t *senderAddr){
-  printf("broadcast message received from %d.%d.\n", senderAddr->u8[0], 
-        senderAddr->u8[1]);
+/*******************************************************************************
+  sense the temperature of the room. The sensor stays active for the minimum 
+  amount of time
+*******************************************************************************/
+static int sample_temperature(void){
+  int temp;
 
-  int* data = (int*)packetbuf_dataptr();
-  int command = *data;
+  stats_app_begin(STATS_APP_MONITORING);
 
-  switch (command){
-    case 6:
-      //the user activate/deactivate the extension
+  SENSORS_ACTIVATE(sht11_sensor);
+  //actual (normalized) temp sample (-39 is the default value)
+  temp = (sht11_sensor.value(SHT11_SENSOR_TEMP)/10-396)/10;
+  //stop the sensing phase
+  SENSORS_DEACTIVATE(sht11_sensor);
 
-      //update the state
-      extension_active = (extension_active)?0:1;
-      human_sensed = 0;
+  //now the desired temperature is the default value
+  temp = temp + 39 + temperature; 
+  //RANDOM_MAX = 65535 -> random_rand()/10000 at most 6 values
+  //             +/-3°(more or less)
+  temp += (int)random_rand()/10000;
 
-      if (extension_active){
-        //the user activate the extension
-        process_start(&sensing_process, NULL);
-      }
+  stats_app_end(STATS_APP_MONITORING);
+
+  return temp;
+}
+
+
+#if SENSING_CONF_BURST
+#if SENSING_CONF_RTIMER
+/*******************************************************************************
+  one sample every BURST_PERIOD, in interrupt context: the sensing process is
+  polled when the burst is complete
+*******************************************************************************/
+static void burst_sample(struct rtimer *t, void *ptr){
+  burst_add(&sound, phidgets.value(PHIDGET5V_1));
+
+  if (burst_full(&sound))
+    process_poll(&sensing_process);
+  else
+    rtimer_set(t, t->time + BURST_PERIOD, 1, burst_sample, NULL);
+}
+
+
+static void burst_start(void){
+  SENSORS_ACTIVATE(phidgets);
+  burst_init(&sound);
+  rtimer_set(&burst_rtimer, RTIMER_NOW() + BURST_PERIOD, 1, burst_sample, 
+                                                                        NULL);
+}
+#else
+/*******************************************************************************
+  ContikiMAC owns the rtimer: the burst is paced by polling the rtimer clock,
+  the CPU stays awake only for the BURST_SAMPLES samples
+*******************************************************************************/
+static void sample_burst(void){
+  rtimer_clock_t next = RTIMER_NOW();
+
+  SENSORS_ACTIVATE(phidgets);
+  burst_init(&sound);
+
+  while (!burst_full(&sound)){
+    while (RTIMER_CLOCK_LT(RTIMER_NOW(), next))
+      ;
+    burst_add(&sound, phidgets.value(PHIDGET5V_1));
+    next += BURST_PERIOD;
+  }
+}
+#endif
+#endif
+
+
+/*******************************************************************************
+  sound level of the room in dB: RMS of a burst of samples, or a single sample
+  without SENSING_CONF_BURST. A short sound (a step, a door) barely moves the
+  RMS of the burst: its peak counts too, less SOUND_CREST_DB, the crest factor
+  of a steady sound, so a steady noise is not raised by its own peaks
+*******************************************************************************/
+#define SOUND_CREST_DB 3
+
+static int sound_level(void){
+#if SENSING_CONF_BURST
+  struct burst_level level;
+  int rms_db, peak_db;
+
+#if !SENSING_CONF_RTIMER
+  sample_burst();
+#endif
+  SENSORS_DEACTIVATE(phidgets);
+
+  burst_analyse(&sound, &level);
+
+  //fixed point conversion, see decibel.h
+  rms_db = decibel_from_mv(decibel_adc_to_mv(level.rms));
+  peak_db = decibel_from_mv(decibel_adc_to_mv(level.peak)) - SOUND_CREST_DB;
+
+  return (peak_db > rms_db)?peak_db:rms_db;
+#else
+  int adc;
+
+  SENSORS_ACTIVATE(phidgets);
+  //obtain the measurement
+  adc = phidgets.value(PHIDGET5V_1);
+  //deactivate the sensor
+  SENSORS_DEACTIVATE(phidgets);
+
+  //fixed point conversion, see decibel.h
+  return decibel_from_mv(decibel_adc_to_mv(adc));
+#endif
+}
+
+
+//the user deactivate the extension behaviour
+static void sensing_stopped(void){
+  SENSORS_DEACTIVATE(phidgets);
+
+  //led red=ON ->stop to use the extension
+  leds_off(LEDS_BLUE);
+  leds_off(LEDS_GREEN);
+  leds_on(LEDS_RED);
+
+  presence_init(&room);
+  sample_to_be_activated = -1;
+}
+
+
+static void update_air_conditioning(int temp, int desired){
+  printf ("Desired temperature = %d. Actual temperature = %d.", desired, temp);
+
+  if (temp > (desired + 1) || temp < (desired - 1))
+    printf(" Activate the air conditioning system.\n");
+  else
+    printf(" Nothing to do.\n");
+}
+
+
+/*******************************************************************************
+  a new version of the state has been adopted: start or stop the sensing when
+  the user activates/deactivates the extension
+*******************************************************************************/
+static void apply_state(void){
+  if (state.extension_active == applied.extension_active){
+    applied = state;
+    return;
+  }
+
+  presence_init(&room);
+
+  if (state.extension_active){
+    //the user activate the extension
+    process_start(&sensing_process, NULL);
+  }
+  else{
+    //the user deactivate the sensing
+    process_exit(&sensing_process);
+    process_exit(&temperature_monitoring_process);
+  }
+
+  applied = state;
+}
 
-      if (!extension_active){
-        //the user deactivate the sensing
-        process_exit(&sensing_process);
-        process_exit(&temperature_monitoring_process);
-      }
 
-      break;
-    default:
-      printf("Error: command not recognized\n");
+/*******************************************************************************
+  commands of the CU in the packetbuf, from the broadcast or the multi-hop 
+  transport
+*******************************************************************************/
+static void handle_commands(const linkaddr_t *from){
+  struct msg_reader reader;
+  struct msg_tlv tlv;
+
+  if (msg_open(&reader) < 0){
+    printf("Error: malformed message\n");
+    return;
+  }
+
+  //a frame repeated by the CU has already been executed
+  if (reader.opcode == MSG_OP_COMMAND && !dedup_check(&cu_window, from,
+                                      msg_epoch(&reader), reader.seqno))
+    return;
+
+  while (msg_next(&reader, &tlv) > 0){
+    switch (tlv.type){
+      case MSG_TLV_STATE:
+        //an old version (a frame received twice, or after Trickle) is ignored
+        if (statesync_recv(&tlv))
+          apply_state();
+
+        break;
+      case MSG_TLV_EPOCH:
+        //already used by the duplicate check
+
+        break;
+      default:
+        printf("Error: command not recognized\n");
+    }
   }
 }
 
 
+static void broadcast_recv(struct broadcast_conn *c, const linkaddr_t *senderAddr){
+  printf("broadcast message received from %d.%d.\n", senderAddr->u8[0], 
+        senderAddr->u8[1]);
+
+  handle_commands(senderAddr);
+}
+
+
+#if TRANSPORT_CONF_MULTIHOP
+static void recv_multihop(const linkaddr_t *from, uint8_t hops){
+  printf("multihop message received from %d.%d, %d hops\n", from->u8[0],
+                                                        from->u8[1], hops);
+
+  handle_commands(from);
+}
+
+static const struct transport_callbacks transport_calls = {recv_multihop, 
+                                                                      NULL};
+#endif
+
 //Be careful to the order
 static const struct broadcast_callbacks broadcast_call = {broadcast_recv, NULL}; 
 static struct broadcast_conn broadcast;
 
 
+/*******************************************************************************
+  the energy reports go to the CU as soon as it is discovered
+*******************************************************************************/
+static void node_found(const linkaddr_t *addr, uint16_t caps){
+  if (!(caps & DISCOVERY_CAP_CU))
+    return;
+
+  printf("CU discovered: %d.%d\n", addr->u8[0], addr->u8[1]);
+  stats_set_receiver(addr);
+}
+
+
 PROCESS_THREAD(main_process, ev, data){
   PROCESS_EXITHANDLER(broadcast_close(&broadcast)); 
 
   PROCESS_BEGIN();
   SENSORS_ACTIVATE(button_sensor);
 
-  broadcast_open(&broadcast, 128, &broadcast_call);
+  setpoint_changed_event = process_alloc_event();
+  home_init(&state);
+  applied = state;
+  presence_init(&room);
+  dedup_init(&cu_window);
+
+  broadcast_open(&broadcast, HOME_CHANNEL_EXTENSION, &broadcast_call);
+#if TRANSPORT_CONF_MULTIHOP
+  transport_open(0, &transport_calls);
+#endif
+
+  //energy reports to the CU, as soon as it is discovered
+  stats_start(&linkaddr_null);
+  discovery_open(DISCOVERY_CAP_PRESENCE, node_found);
+  statesync_open(&state, apply_state);
+  //modules disseminated by the CU (see loader.h)
+  loader_open(0);
+
   //extension off by default
   leds_on(LEDS_RED);
   leds_off(LEDS_GREEN);
@@ -81,7 +317,7 @@ PROCESS_THREAD(main_process, ev, data){
     PROCESS_WAIT_EVENT_UNTIL(ev == sensors_event && data == &button_sensor);
 
     //refuse to modify the temperature if the extension is not active
-    if (!extension_active){
+    if (!state.extension_active){
       printf("Command rejected: activate the extension first\n");
       continue;
     }
@@ -93,6 +329,11 @@ PROCESS_THREAD(main_process, ev, data){
       temperature = 18;
 
     printf("temperature = %d\n", temperature);
+
+    //the temperature monitoring checks the new value with the last reading
+    if (process_is_running(&temperature_monitoring_process))
+      process_post(&temperature_monitoring_process, setpoint_changed_event, 
+                                                                        NULL);
   }
 
   PROCESS_END();
@@ -102,181 +343,159 @@ PROCESS_THREAD(main_process, ev, data){
 PROCESS_THREAD(sensing_process, ev, data)
 {
   static struct etimer sensing_timer;
+  static clock_time_t sensing_interval;
+  static clock_time_t last_sample;
+  static clock_time_t elapsed;
+  clock_time_t now;
+  int db;
+
+  PROCESS_EXITHANDLER(etimer_stop(&sensing_timer); sensing_stopped());
 
   PROCESS_BEGIN();
 
-  etimer_set(&sensing_timer, CLOCK_SECOND);
+  sensing_interval = SENSING_MIN_INTERVAL;
+  last_sample = clock_time();
+  etimer_set(&sensing_timer, sensing_interval);
   //led red=ON ->stop to use the extension
   leds_off(LEDS_RED);
 
   while(1) {
-    PROCESS_WAIT_EVENT();
-    if (etimer_expired(&sensing_timer)){
-      double aux;
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&sensing_timer));
 
-      //reset the timer
-      etimer_reset(&sensing_timer);
-      //while sensing the blue led toggle
-      leds_toggle(LEDS_BLUE);
+    //the counters are in time, not in samples: the interval changes
+    now = clock_time();
+    elapsed = now - last_sample;
+    last_sample = now;
 
+    //while sensing the blue led toggle
+    leds_toggle(LEDS_BLUE);
 
-      SENSORS_ACTIVATE(phidgets);
-      //obtain the measurement
-      aux = phidgets.value(PHIDGET5V_1);
-      //deactivate the sensor
-      SENSORS_DEACTIVATE(phidgets);
-      
-      aux *= 3300;  // battery ref value typical when connected over USB
-      //aux = (aux>>12); //divide by 4096
-      aux /= 4096;
-      aux *= 5000;  //External voltage reference as
-      aux /= 3000;  //internal voltage divider for the 5V phidget (ADC0,
-                    //ADC3) has 5:3 relationship
-
-      //printf("aux:%d\n", (int)aux);
-      int a = (int)aux;
-      int db = 20 * log10f((double)a);
-      
+#if SENSING_CONF_BURST && SENSING_CONF_RTIMER
+    //the burst is taken by the rtimer while the process sleeps
+    burst_start();
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+#endif
+
+    stats_app_begin(STATS_APP_SENSING);
+    db = sound_level();
 
 /*******************************************************************************/
-      if (sample_to_be_activated == -1){
-        //RANDOM_MAX = 65535 -> random_rand()/6000 at most 10 values
-        //[-5, 5]
-        //if I obtain 0 then i will use a fixed db value
-        int random_number = (int)random_rand()/6000;
-        //printf("Random=%d sample_to_be_activated=%d\n", random_number, sample_to_be_activated);
-
-        if (random_number == 0){
-          printf("random = 0!\n");
-          if (!human_sensed)
-            sample_to_be_activated = 1;
-          else
-            sample_to_be_activated = 0;
-        }
+    if (sample_to_be_activated == -1){
+      //RANDOM_MAX = 65535 -> random_rand()/6000 at most 10 values
+      //[-5, 5]
+      //if I obtain 0 then i will use a fixed db value
+      int random_number = (int)random_rand()/6000;
+      //printf("Random=%d sample_to_be_activated=%d\n", random_number, sample_to_be_activated);
+
+      if (random_number == 0){
+        printf("random = 0!\n");
+        if (!room.human_sensed)
+          sample_to_be_activated = 1;
+        else
+          sample_to_be_activated = 0;
       }
+    }
 
-      if (sample_to_be_activated == 1)
-        db = 80;
-      if (sample_to_be_activated == 0)
-        db = 10;
+    if (sample_to_be_activated == 1)
+      db = 80;
+    if (sample_to_be_activated == 0)
+      db = 10;
 
-      //printf ("db %d\n", db);
+    //printf ("db %d\n", db);
 /*********************************************************************************/      
 
-      if (db<=20 && human_sensed){
-        sample_silence++;
-        sample_noise = 0;
-
-        if (sample_silence >= SAMPLE_TO_DEACTIVATE){
-          sample_to_be_activated = -1;
-
-          //there is none in the room
-          human_sensed = 0;
-          //the green led is on if someone is inside
-          leds_off(LEDS_GREEN);
-
-          //monitors the temperature is not usefull anymore
-          process_exit(&temperature_monitoring_process);
-
-          //during the night we turn off the tv's leds
-          //sensing for the minimun amount of time
-          SENSORS_ACTIVATE(light_sensor);
-          //normalized sample of light
-          int light = 10*light_sensor.value(LIGHT_SENSOR_PHOTOSYNTHETIC)/7;
-          printf("Sensed light %d lux. ", light);
-          SENSORS_DEACTIVATE(light_sensor);
-
-          if (light < 10)
-            printf("Leds = off\n");
-          else 
-            printf("Nothing to do.\n");
-        }
-      }
+    switch (presence_update(&room, db, elapsed)){
+      case PRESENCE_LEFT:
+        sample_to_be_activated = -1;
 
-      if (db>20 && !human_sensed){
-        sample_noise++;
-        sample_silence = 0;
+        //the green led is on if someone is inside
+        leds_off(LEDS_GREEN);
 
-        if (sample_noise >= SAMPLE_TO_ACTIVATE){
-          sample_to_be_activated = -1;
+        //monitors the temperature is not usefull anymore
+        process_exit(&temperature_monitoring_process);
 
-          //someone is inside the room
-          human_sensed = 1;
-          //the green led is on if someone is inside
-          leds_on(LEDS_GREEN);
+        //during the night we turn off the tv's leds
+        //sensing for the minimun amount of time
+        SENSORS_ACTIVATE(light_sensor);
+        //normalized sample of light
+        int light = 10*light_sensor.value(LIGHT_SENSOR_PHOTOSYNTHETIC)/7;
+        printf("Sensed light %d lux. ", light);
+        SENSORS_DEACTIVATE(light_sensor);
 
-          process_start(&temperature_monitoring_process, NULL);
-        }
-      } 
-    }
-     
-    if (ev == PROCESS_EVENT_EXIT){
-      //the user deactivate the extension behaviour
+        if (light < 10)
+          printf("Leds = off\n");
+        else 
+          printf("Nothing to do.\n");
+
+        break;
+      case PRESENCE_ARRIVED:
+        sample_to_be_activated = -1;
 
-      //led red=ON ->stop to use the extension
-      leds_off(LEDS_BLUE);
-      leds_off(LEDS_GREEN);
-      leds_on(LEDS_RED);
+        //the green led is on if someone is inside
+        leds_on(LEDS_GREEN);
 
-      etimer_stop(&sensing_timer);
+        process_start(&temperature_monitoring_process, NULL);
 
-      sample_noise = 0;
-      sample_silence = 0;
-      sample_to_be_activated = -1;
+        break;
     }
+
+    //schedule the next sample
+    sensing_interval = presence_next_interval(&room, sensing_interval, db);
+    etimer_set(&sensing_timer, sensing_interval);
+
+    stats_app_end(STATS_APP_SENSING);
   }
   PROCESS_END();
 }
 
 
+/*******************************************************************************
+  the temperature is sampled only when the timer of the process expires (the 
+  SHT11 is the slowest sensor of the board). The decision about the air 
+  conditioning is taken again only when the reading or the desired temperature
+  changes
+*******************************************************************************/
 PROCESS_THREAD(temperature_monitoring_process, ev, data){
   static struct etimer temperature_timer;
-  int temp;
+  //last reading and the desired temperature it has been compared with
+  static int last_temp;
+  static int last_setpoint;
+
+  PROCESS_EXITHANDLER(etimer_stop(&temperature_timer); 
+                      printf("Air conditioner = off\n"));
 
   PROCESS_BEGIN();
   printf("Someone is inside\n");
 
+  //first decision at once
+  last_temp = sample_temperature();
+  last_setpoint = temperature;
+  update_air_conditioning(last_temp, last_setpoint);
+
   //check the temperature every 10 seconds
   etimer_set(&temperature_timer, CLOCK_SECOND*10);
 
   while(1){
-    if (ev == sensors_event && data != &button_sensor)
-      continue;
-
-    if (human_sensed && extension_active){ 
-
-      //the sensor has to stay active for the minimum amount of time
-      SENSORS_ACTIVATE(sht11_sensor);
-      //actual (normalized) temp sample (-39 is the default value)
-      temp = (sht11_sensor.value(SHT11_SENSOR_TEMP)/10-396)/10;
-      //now the desired temperature is the default value
-      temp = temp + 39 + temperature; 
-      //RANDOM_MAX = 65535 -> random_rand()/10000 at most 6 values
-      //             +/-3°(more or less)
-      temp += (int)random_rand()/10000;
-      //stop the sensing phase
-      SENSORS_DEACTIVATE(sht11_sensor);
-    
-      printf ("Desired temperature = %d. Actual temperature = %d.", 
-          temperature, temp);
-      if (temp > (temperature + 1) || temp < (temperature - 1))
-        printf(" Activate the air conditioning system.\n");
-      else
-        printf(" Nothing to do.\n");
-    }
+    PROCESS_WAIT_EVENT_UNTIL((ev == PROCESS_EVENT_TIMER && 
+                  data == &temperature_timer) || ev == setpoint_changed_event);
 
-    PROCESS_WAIT_EVENT(); 
-    
-    if (etimer_expired(&temperature_timer)){
+    if (ev == PROCESS_EVENT_TIMER){
       //every 10 seconds!!
       etimer_reset(&temperature_timer);
-    }
 
-    if (ev == PROCESS_EVENT_EXIT){
-      etimer_stop(&temperature_timer);
-      printf("Air conditioner = off\n");
+      int temp = sample_temperature();
+      if (temp == last_temp && temperature == last_setpoint)
+        continue;
+
+      last_temp = temp;
     }
+    else if (temperature == last_setpoint)
+      //the user came back to the same value
+      continue;
+
+    last_setpoint = temperature;
+    update_air_conditioning(last_temp, last_setpoint);
   }
 
   PROCESS_END();
-}
\ No newline at end of file
+}
@@ -0,0 +1,140 @@
+#include "contiki.h"
+#include "stdio.h"
+#include "groupack.h"
+#include "discovery.h"
+#include "transport.h"
+
+
+int groupack_begin(struct groupack *g, uint8_t seqno, uint16_t cap){
+  uint8_t buf[2*GROUPACK_MAX_MEMBERS];
+  const linkaddr_t *member;
+  uint8_t index = 0;
+
+  g->seqno = seqno;
+  g->count = 0;
+  g->acked = 0;
+  g->nacked = 0;
+
+  while (g->count < GROUPACK_MAX_MEMBERS &&
+                              (member = discovery_next(cap, &index)) != NULL){
+    linkaddr_copy(&g->members[g->count], member);
+    buf[2*g->count] = member->u8[0];
+    buf[2*g->count + 1] = member->u8[1];
+    g->count++;
+  }
+
+  msg_append(MSG_TLV_GROUP, buf, 2*g->count);
+
+  return g->count;
+}
+
+
+int groupack_recv(struct groupack *g, const struct msg_tlv *tlv){
+  uint8_t index;
+
+  //an ack of another (older) group command
+  if (tlv->len < 3 || tlv->value[0] != g->seqno || tlv->value[1] >= g->count)
+    return 0;
+
+  index = tlv->value[1];
+  if (tlv->value[2] == 0)
+    g->acked |= 1 << index;
+  else{
+    g->nacked |= 1 << index;
+    g->reasons[index] = tlv->value[2];
+  }
+
+  return groupack_missing(g) == 0;
+}
+
+
+uint8_t groupack_missing(const struct groupack *g){
+  uint8_t all = (g->count == 8)?0xff:((1 << g->count) - 1);
+
+  return all & ~(g->acked | g->nacked);
+}
+
+
+void groupack_report(const struct groupack *g){
+  uint8_t i;
+
+  printf("Group command %d: %d members, acked 0x%02x, refused 0x%02x, missing 0x%02x\n",
+          g->seqno, g->count, g->acked, g->nacked, groupack_missing(g));
+
+  for (i = 0; i < g->count; i++){
+    if (g->nacked & (1 << i))
+      printf("Node %d.%d refused the command, error %d\n",
+          g->members[i].u8[0], g->members[i].u8[1], g->reasons[i]);
+    else if (!(g->acked & (1 << i)))
+      printf("Node %d.%d did not answer\n", g->members[i].u8[0],
+                                                        g->members[i].u8[1]);
+  }
+}
+
+
+/*******************************************************************************
+  node side
+*******************************************************************************/
+void groupack_member_init(struct groupack_member *m, struct sendqueue *sq){
+  m->valid = 0;
+  m->index = -1;
+  m->sq = sq;
+}
+
+
+static void send_ack(void *ptr){
+  struct groupack_member *m = (struct groupack_member*)ptr;
+  uint8_t buf[3];
+
+  buf[0] = m->seqno;
+  buf[1] = m->index;
+  buf[2] = m->status;
+
+  msg_begin(MSG_OP_REPLY, 0);
+  msg_append(MSG_TLV_ACK, buf, sizeof(buf));
+  transport_send_to_cu(m->sq);
+}
+
+
+/*******************************************************************************
+  the ack leaves in the slot of the member, and never from inside the recv
+  callback that is still reading the frame
+*******************************************************************************/
+static void schedule_ack(struct groupack_member *m){
+  if (m->index < 0)
+    return;
+
+  ctimer_set(&m->timer, (m->index + 1)*GROUPACK_SLOT, send_ack, m);
+}
+
+
+int groupack_join(struct groupack_member *m, const struct msg_tlv *tlv,
+                                                              uint8_t seqno){
+  uint8_t i;
+
+  if (m->valid && m->seqno == seqno){
+    //retransmission: the CU has missed the ack
+    schedule_ack(m);
+    return 0;
+  }
+
+  m->valid = 1;
+  m->seqno = seqno;
+  m->status = 0;
+  m->index = -1;
+
+  for (i = 0; i + 1 < tlv->len; i += 2)
+    if (tlv->value[i] == linkaddr_node_addr.u8[0] &&
+                                tlv->value[i + 1] == linkaddr_node_addr.u8[1]){
+      m->index = i/2;
+      break;
+    }
+
+  return 1;
+}
+
+
+void groupack_done(struct groupack_member *m, uint8_t status){
+  m->status = status;
+  schedule_ack(m);
+}
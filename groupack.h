@@ -0,0 +1,86 @@
+#ifndef GROUPACK_H_
+#define GROUPACK_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+#include "message.h"
+#include "sendqueue.h"
+
+/*******************************************************************************
+  Group commands with aggregated acknowledgements.
+
+  The CU broadcasts a group command once, with a GROUP entry that lists the
+  members expected to execute it (the nodes discovered with the capability of
+  the destination). Each member answers with an ACK carrying its position in
+  the list and its status: 0, or the reason why it refused the command (a
+  NACK). The members answer in turn, GROUPACK_SLOT after each other, so that
+  the acks do not collide.
+
+  The CU aggregates the answers in a bitmap. If some member is still missing
+  at the deadline the same frame (same sequence number) is broadcast again, up
+  to GROUPACK_MAX_ROUNDS times. A member remembers the last group command it
+  executed: a retransmission is acknowledged again, but not executed twice.
+*******************************************************************************/
+
+#define GROUPACK_MAX_MEMBERS 8
+#define GROUPACK_SLOT (CLOCK_SECOND/16)
+//time the CU waits for the acks of a round
+#define GROUPACK_DEADLINE (CLOCK_SECOND + GROUPACK_MAX_MEMBERS*GROUPACK_SLOT)
+#define GROUPACK_MAX_ROUNDS 3
+
+//CU side: a group command in progress
+struct groupack {
+  uint8_t seqno;
+  uint8_t count;                              //members
+  linkaddr_t members[GROUPACK_MAX_MEMBERS];
+  uint8_t acked;                              //bitmap of the ACKs
+  uint8_t nacked;                             //bitmap of the NACKs
+  uint8_t reasons[GROUPACK_MAX_MEMBERS];      //status of the NACKs
+};
+
+/*
+  start a group command with the nodes with capability cap: the GROUP entry
+  is appended to the frame in the packetbuf, right after msg_begin. Return the
+  number of members
+*/
+int groupack_begin(struct groupack *g, uint8_t seqno, uint16_t cap);
+
+/*
+  account an ACK entry. Return 1 when every member has answered
+*/
+int groupack_recv(struct groupack *g, const struct msg_tlv *tlv);
+
+//bitmap of the members that did not answer
+uint8_t groupack_missing(const struct groupack *g);
+
+//print the outcome of the command
+void groupack_report(const struct groupack *g);
+
+
+//node side: the last group command received
+struct groupack_member {
+  uint8_t valid;
+  uint8_t seqno;
+  int8_t index;             //position in the group, -1 if not a member
+  uint8_t status;
+  struct sendqueue *sq;     //queue towards the CU
+  struct ctimer timer;
+};
+
+void groupack_member_init(struct groupack_member *m, struct sendqueue *sq);
+
+/*
+  GROUP entry of the frame seqno. Return 1 if the commands of the frame have
+  to be executed, 0 if it is a retransmission of the last group command: the
+  ack is sent again and the commands must be skipped
+*/
+int groupack_join(struct groupack_member *m, const struct msg_tlv *tlv,
+                                                              uint8_t seqno);
+
+/*
+  the commands of the group command have been executed with status (0 or
+  MSG_ERR_*): the ack is sent in the slot of the member
+*/
+void groupack_done(struct groupack_member *m, uint8_t status);
+
+#endif /* GROUPACK_H_ */
@@ -0,0 +1,391 @@
+#include "contiki.h"
+#include "cfs/cfs.h"
+#if HISTORY_CONF_COFFEE
+#include "cfs/cfs-coffee.h"
+#endif
+#include "stdio.h"
+#include "history.h"
+
+/*
+  record on the flash: time (uint32), value (int16), samples merged (uint8).
+  The last byte is never 0: Coffee finds the end of a file after a reboot by
+  looking for the last byte written
+*/
+#define RECORD_LEN 7
+#define SEGMENT_SIZE ((cfs_offset_t)HISTORY_SEGMENT_RECORDS * RECORD_LEN)
+//records read at once by a scan
+#define SCAN_RECORDS 8
+
+#define LEVELS 2
+
+struct record {
+  unsigned long time;
+  int16_t value;
+  uint8_t count;
+};
+
+//index of a segment
+struct segment {
+  unsigned long first;
+  unsigned long last;
+  uint16_t records;
+};
+
+static const uint8_t level_segments[LEVELS] = {
+  HISTORY_RAW_SEGMENTS, HISTORY_COMPACT_SEGMENTS
+};
+static struct segment raw_segments[HISTORY_RAW_SEGMENTS];
+static struct segment compact_segments[HISTORY_COMPACT_SEGMENTS];
+static struct segment *const levels[LEVELS] = {raw_segments, compact_segments};
+//segment being written, for each level
+static uint8_t active[LEVELS];
+
+//samples not written yet
+static uint8_t batch[HISTORY_BATCH * RECORD_LEN];
+static uint8_t batch_len;
+
+//history_now() at boot
+static unsigned long time_base;
+
+
+static void segment_name(char *name, uint8_t level, uint8_t segment){
+  sprintf(name, "hist%u.%u", level, segment);
+}
+
+
+static void encode(uint8_t *buf, const struct record *r){
+  buf[0] = r->time & 0xff;
+  buf[1] = (r->time >> 8) & 0xff;
+  buf[2] = (r->time >> 16) & 0xff;
+  buf[3] = (r->time >> 24) & 0xff;
+  buf[4] = (uint16_t)r->value & 0xff;
+  buf[5] = ((uint16_t)r->value >> 8) & 0xff;
+  buf[6] = r->count;
+}
+
+
+static void decode(const uint8_t *buf, struct record *r){
+  r->time = (unsigned long)buf[0] | ((unsigned long)buf[1] << 8) |
+            ((unsigned long)buf[2] << 16) | ((unsigned long)buf[3] << 24);
+  r->value = (int16_t)(buf[4] | (buf[5] << 8));
+  r->count = buf[6];
+}
+
+
+/*******************************************************************************
+  read the records of a segment from the first one, count at most. Return the
+  number of records read
+*******************************************************************************/
+static uint16_t read_records(int fd, uint8_t *buf, uint16_t count){
+  int len = cfs_read(fd, buf, count * RECORD_LEN);
+
+  return (len < 0)?0:(uint16_t)(len / RECORD_LEN);
+}
+
+
+/*******************************************************************************
+  the index of a segment from its file
+*******************************************************************************/
+static void load_segment(uint8_t level, uint8_t n){
+  struct segment *seg = &levels[level][n];
+  uint8_t buf[RECORD_LEN];
+  struct record r;
+  cfs_offset_t size;
+  char name[12];
+  int fd;
+
+  seg->records = 0;
+
+  segment_name(name, level, n);
+  fd = cfs_open(name, CFS_READ);
+  if (fd < 0)
+    return;
+
+  size = cfs_seek(fd, 0, CFS_SEEK_END);
+  if (size >= RECORD_LEN){
+    seg->records = size / RECORD_LEN;
+
+    cfs_seek(fd, 0, CFS_SEEK_SET);
+    read_records(fd, buf, 1);
+    decode(buf, &r);
+    seg->first = r.time;
+
+    cfs_seek(fd, (cfs_offset_t)(seg->records - 1) * RECORD_LEN, CFS_SEEK_SET);
+    read_records(fd, buf, 1);
+    decode(buf, &r);
+    seg->last = r.time;
+  }
+
+  cfs_close(fd);
+}
+
+
+/*******************************************************************************
+  an empty segment, with its space reserved on the flash
+*******************************************************************************/
+static void clear_segment(uint8_t level, uint8_t n){
+  char name[12];
+
+  segment_name(name, level, n);
+  cfs_remove(name);
+#if HISTORY_CONF_COFFEE
+  cfs_coffee_reserve(name, SEGMENT_SIZE);
+#endif
+
+  levels[level][n].records = 0;
+}
+
+
+static void append(uint8_t level, const uint8_t *buf, uint16_t count);
+
+
+/*******************************************************************************
+  the raw segment n is about to be reused: its samples are merged
+  HISTORY_COMPACT at a time and appended to level 1
+*******************************************************************************/
+static void compact(uint8_t n){
+  uint8_t buf[SCAN_RECORDS * RECORD_LEN];
+  uint8_t out[HISTORY_SEGMENT_RECORDS / HISTORY_COMPACT * RECORD_LEN];
+  uint16_t read, i, produced = 0;
+  struct record r, merged;
+  long sum = 0;
+  char name[12];
+  int fd;
+
+  segment_name(name, 0, n);
+  fd = cfs_open(name, CFS_READ);
+  if (fd < 0)
+    return;
+
+  merged.count = 0;
+  while ((read = read_records(fd, buf, SCAN_RECORDS)) > 0){
+    for (i = 0; i < read; i++){
+      decode(buf + i*RECORD_LEN, &r);
+
+      if (merged.count == 0){
+        merged.time = r.time;
+        sum = 0;
+      }
+      sum += r.value;
+      merged.count++;
+
+      if (merged.count == HISTORY_COMPACT){
+        merged.value = (int16_t)(sum / merged.count);
+        encode(out + produced*RECORD_LEN, &merged);
+        produced++;
+        merged.count = 0;
+      }
+    }
+  }
+  cfs_close(fd);
+
+  //the samples left over
+  if (merged.count > 0){
+    merged.value = (int16_t)(sum / merged.count);
+    encode(out + produced*RECORD_LEN, &merged);
+    produced++;
+  }
+
+  append(1, out, produced);
+}
+
+
+/*******************************************************************************
+  move to the next segment of a level: the oldest one, compacted first if it
+  holds raw samples
+*******************************************************************************/
+static void next_segment(uint8_t level){
+  uint8_t n = (active[level] + 1) % level_segments[level];
+
+  if (level == 0 && levels[0][n].records > 0)
+    compact(n);
+
+  clear_segment(level, n);
+  active[level] = n;
+}
+
+
+/*******************************************************************************
+  append count records to the active segment of a level, in a single write
+  as long as the segment has room
+*******************************************************************************/
+static void append(uint8_t level, const uint8_t *buf, uint16_t count){
+  struct segment *seg;
+  struct record r;
+  uint16_t room, n;
+  char name[12];
+  int fd;
+
+  while (count > 0){
+    seg = &levels[level][active[level]];
+    if (seg->records >= HISTORY_SEGMENT_RECORDS){
+      next_segment(level);
+      continue;
+    }
+
+    room = HISTORY_SEGMENT_RECORDS - seg->records;
+    n = (count < room)?count:room;
+
+    segment_name(name, level, active[level]);
+    fd = cfs_open(name, CFS_WRITE | CFS_APPEND);
+    if (fd < 0){
+      printf("History: cannot open %s\n", name);
+      return;
+    }
+    cfs_write(fd, buf, n * RECORD_LEN);
+    cfs_close(fd);
+
+    decode(buf, &r);
+    if (seg->records == 0)
+      seg->first = r.time;
+    decode(buf + (n - 1)*RECORD_LEN, &r);
+    seg->last = r.time;
+    seg->records += n;
+
+    buf += n * RECORD_LEN;
+    count -= n;
+  }
+}
+
+
+void history_init(void){
+  unsigned long last = 0;
+  uint8_t level, n;
+  int found;
+
+  for (level = 0; level < LEVELS; level++){
+    found = -1;
+
+    for (n = 0; n < level_segments[level]; n++){
+      load_segment(level, n);
+
+      //the newest segment is the one being written
+      if (levels[level][n].records > 0 && (found < 0 ||
+                            levels[level][n].last >= levels[level][found].last))
+        found = n;
+    }
+
+    if (found < 0){
+      //empty flash
+      active[level] = 0;
+      clear_segment(level, 0);
+      continue;
+    }
+
+    active[level] = found;
+    if (levels[level][found].last > last)
+      last = levels[level][found].last;
+  }
+
+  batch_len = 0;
+  //the time goes on from the last record
+  time_base = last + 1;
+
+  printf("History: %u raw segments, time %lu\n", HISTORY_RAW_SEGMENTS,
+                                                                  time_base);
+}
+
+
+unsigned long history_now(void){
+  return time_base + clock_seconds();
+}
+
+
+void history_add(int16_t value){
+  struct record r;
+
+  r.time = history_now();
+  r.value = value;
+  r.count = 1;
+  encode(batch + batch_len*RECORD_LEN, &r);
+
+  //a page at a time
+  if (++batch_len == HISTORY_BATCH){
+    append(0, batch, batch_len);
+    batch_len = 0;
+  }
+}
+
+
+/*******************************************************************************
+  account the records of buf in the window [from, before)
+*******************************************************************************/
+static void account(const uint8_t *buf, uint16_t count, unsigned long from,
+                            unsigned long before, struct history_stats *stats,
+                            long *sum){
+  struct record r;
+  uint16_t i;
+
+  for (i = 0; i < count; i++){
+    decode(buf + i*RECORD_LEN, &r);
+    if (r.time < from || r.time >= before)
+      continue;
+
+    if (stats->count == 0 || r.value < stats->min)
+      stats->min = r.value;
+    if (stats->count == 0 || r.value > stats->max)
+      stats->max = r.value;
+
+    *sum += (long)r.value * r.count;
+    stats->count += r.count;
+  }
+}
+
+
+static void scan_segment(uint8_t level, uint8_t n, unsigned long from,
+                            unsigned long before, struct history_stats *stats,
+                            long *sum){
+  uint8_t buf[SCAN_RECORDS * RECORD_LEN];
+  const struct segment *seg = &levels[level][n];
+  uint16_t read;
+  char name[12];
+  int fd;
+
+  //the index tells if the segment has something in the window
+  if (seg->records == 0 || seg->last < from || seg->first >= before)
+    return;
+
+  segment_name(name, level, n);
+  fd = cfs_open(name, CFS_READ);
+  if (fd < 0)
+    return;
+
+  while ((read = read_records(fd, buf, SCAN_RECORDS)) > 0)
+    account(buf, read, from, before, stats, sum);
+
+  cfs_close(fd);
+}
+
+
+uint16_t history_query(unsigned long from, unsigned long to,
+                                                struct history_stats *stats){
+  unsigned long raw_start = to + 1;
+  struct record r;
+  long sum = 0;
+  uint8_t n;
+
+  stats->count = 0;
+  stats->mean = stats->min = stats->max = 0;
+
+  //raw samples first: the compacted ones are used only before them
+  for (n = 0; n < HISTORY_RAW_SEGMENTS; n++){
+    if (raw_segments[n].records > 0 && raw_segments[n].first < raw_start)
+      raw_start = raw_segments[n].first;
+    scan_segment(0, n, from, to + 1, stats, &sum);
+  }
+  account(batch, batch_len, from, to + 1, stats, &sum);
+  if (batch_len > 0){
+    decode(batch, &r);
+    if (r.time < raw_start)
+      raw_start = r.time;
+  }
+
+  for (n = 0; n < HISTORY_COMPACT_SEGMENTS; n++)
+    scan_segment(1, n, from, (raw_start < to + 1)?raw_start:to + 1, stats,
+                                                                        &sum);
+
+  if (stats->count > 0)
+    stats->mean = (int16_t)(sum / stats->count);
+
+  return stats->count;
+}
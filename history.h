@@ -0,0 +1,64 @@
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include "contiki.h"
+
+/*******************************************************************************
+  Temperature history of Node1 on the external flash (Coffee).
+
+  The samples are appended to a log made of segments, files of Coffee with a
+  fixed size reserved in advance (so Coffee never has to move them):
+    - level 0, HISTORY_RAW_SEGMENTS segments of raw samples, used as a ring
+    - level 1, HISTORY_COMPACT_SEGMENTS segments of compacted samples
+  The samples are written HISTORY_BATCH at a time, about a page of flash, so
+  the flash is written once every few minutes instead of at every sample.
+  When the ring of raw samples is full its oldest segment is compacted before
+  being reused: every HISTORY_COMPACT samples become their mean, appended to
+  level 1. The oldest segment of level 1 is simply dropped when it is reused.
+
+  A small index in RAM keeps the first and the last time and the number of
+  records of each segment, so a query reads only the segments of its window.
+  The index is rebuilt from the files after a reboot; the samples of the
+  batch not yet written are lost.
+
+  The time of the history is in seconds and never goes back: after a reboot
+  it starts again from the last record on the flash.
+*******************************************************************************/
+
+//records written at once: 36*7 = 252 bytes, a page of the sky flash
+#define HISTORY_BATCH 36
+//records of a segment (8 batches, 48 minutes of samples every 10 seconds)
+#define HISTORY_SEGMENT_RECORDS (8*HISTORY_BATCH)
+
+#define HISTORY_RAW_SEGMENTS 4
+#define HISTORY_COMPACT_SEGMENTS 2
+//raw samples merged in a compacted record
+#define HISTORY_COMPACT 12
+
+struct history_stats {
+  uint16_t count;       //samples in the window
+  int16_t mean;
+  int16_t min;
+  int16_t max;
+};
+
+/*
+  rebuild the index from the flash
+*/
+void history_init(void);
+
+//current time of the history
+unsigned long history_now(void);
+
+//record a sample taken now
+void history_add(int16_t value);
+
+/*
+  statistics of the samples taken between from and to (history_now() times,
+  inclusive). The min and the max of the compacted part are the ones of the
+  means of HISTORY_COMPACT samples. Return the number of samples
+*/
+uint16_t history_query(unsigned long from, unsigned long to,
+                                                  struct history_stats *stats);
+
+#endif /* HISTORY_H_ */
@@ -0,0 +1,74 @@
+#include "home.h"
+#include "message.h"
+
+
+void home_init(struct home_state *state){
+  state->alarm_state = 0;
+  state->gate_locked = 1;
+  state->extension_active = 0;
+}
+
+
+int home_command_allowed(const struct home_state *state, int command){
+  //the alarm is active and the command is not "deactivate the alarm"
+  if (state->alarm_state && command != MSG_CMD_ALARM)
+    return 0;
+
+  return 1;
+}
+
+
+int home_apply(struct home_state *state, int command){
+  switch (command){
+    case MSG_CMD_ALARM:
+      //activate/deactivate the alarm
+      state->alarm_state = (state->alarm_state == 0)?1:0;
+      return 1;
+    case MSG_CMD_GATE:
+      //the gate is opened/closed
+      state->gate_locked = (state->gate_locked == 0)?1:0;
+      return 1;
+    case MSG_CMD_EXTENSION:
+      //the user activate/deactivate the extension
+      state->extension_active = (state->extension_active)?0:1;
+      return 1;
+    default:
+      //the other commands do not change the state
+      return 0;
+  }
+}
+
+
+int home_command_route(int command, uint8_t *entry_type){
+  switch (command){
+    case MSG_CMD_ALARM:
+      //every regular node reacts, in broadcast, to the new state vector
+      *entry_type = MSG_TLV_STATE;
+      return DEST_REGULAR_NODES;
+    case MSG_CMD_OPEN:
+    case MSG_CMD_UPLOAD:
+      *entry_type = command;
+      return DEST_REGULAR_NODES;
+    case MSG_CMD_GATE:
+      //node 2 (garden) opens/closes the gate
+      *entry_type = MSG_TLV_STATE;
+      return DEST_NODE2;
+    case MSG_CMD_LIGHT:
+      //node 2 (garden) senses the outer light
+      *entry_type = command;
+      return DEST_NODE2;
+    case MSG_CMD_TEMPERATURE:
+      //node 1 computes the mean temperature
+      *entry_type = command;
+      return DEST_NODE1;
+    case MSG_CMD_HISTORY:
+      //node 1 keeps the temperature history on its flash
+      *entry_type = command;
+      return DEST_NODE1;
+    case MSG_CMD_EXTENSION:
+      *entry_type = MSG_TLV_STATE;
+      return DEST_EXTENSION_NODE;
+    default:
+      return -1;
+  }
+}
@@ -0,0 +1,62 @@
+#ifndef HOME_H_
+#define HOME_H_
+
+#include <stdint.h>
+
+/*******************************************************************************
+  Home automation logic, without any access to sensors, leds or radio: the
+  state of the house, which commands are allowed in a state, how a command
+  changes the state and where the CU has to send it. The state is replicated
+  on the CU and on every node, with a version number (see statesync.h): the CU
+  changes it with home_apply and the nodes adopt the new version.
+
+  The commands are the ones of the CU menu (MSG_CMD_* in message.h).
+*******************************************************************************/
+
+struct home_state {
+  uint8_t alarm_state;        //unlocked (0) by default
+  uint8_t gate_locked;        //gate locked (1) by default
+  uint8_t extension_active;   //extension not enabled (0) by default
+};
+
+/*
+  rime channels of the roles, shared by every node with that role. The
+  addresses of the nodes are not fixed: the CU finds them by capability
+  (see discovery.h)
+*/
+#define HOME_CHANNEL_EXTENSION 128    //broadcast to the extension nodes
+#define HOME_CHANNEL_REGULAR   129    //broadcast to the regular nodes
+#define HOME_CHANNEL_GATE      130    //runicast with the garden nodes
+#define HOME_CHANNEL_DOOR      131    //runicast with the door nodes
+
+//destinations of the commands sent by the CU
+enum {
+  DEST_REGULAR_NODES,     //broadcast on HOME_CHANNEL_REGULAR
+  DEST_EXTENSION_NODE,    //broadcast on HOME_CHANNEL_EXTENSION
+  DEST_NODE1,             //runicast to every door node (temperature)
+  DEST_NODE2,             //runicast to every garden node (gate, light)
+  DEST_NUM
+};
+
+void home_init(struct home_state *state);
+
+/*
+  return 1 if the command can be executed in the current state: while the alarm
+  is active the only command accepted is its deactivation
+*/
+int home_command_allowed(const struct home_state *state, int command);
+
+/*
+  update the state after the command. Return 1 if the state has changed, 0 for
+  the commands that do not change it
+*/
+int home_apply(struct home_state *state, int command);
+
+/*
+  return the destination (DEST_*) of the command and set the type of its frame
+  entry, -1 if the command does not exist. The commands that change the state
+  travel as a STATE entry with the new vector
+*/
+int home_command_route(int command, uint8_t *entry_type);
+
+#endif /* HOME_H_ */
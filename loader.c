@@ -0,0 +1,166 @@
+#include "contiki.h"
+#include "net/rime/rime.h"
+#include "net/rime/rudolph1.h"
+#include "cfs/cfs.h"
+#include "loader/elfloader.h"
+#include "sys/autostart.h"
+#include "stdio.h"
+#include "loader.h"
+
+static struct rudolph1_conn rudolph;
+static int is_source;
+//size of the module written by the CU
+static long module_size;
+
+PROCESS(loader_process, "Module loader");
+
+
+/*******************************************************************************
+  a chunk of a new version of the module, from a neighbour. The last one
+  makes the node load the module, outside of the callback
+*******************************************************************************/
+static void write_chunk(struct rudolph1_conn *c, int offset, int flag,
+                                                    uint8_t *data, int len){
+  int fd;
+
+  if (flag == RUDOLPH1_FLAG_NEWFILE){
+    printf("Loader: receiving module version %u\n", c->version);
+    fd = cfs_open(LOADER_FILE, CFS_WRITE);
+  }
+  else
+    fd = cfs_open(LOADER_FILE, CFS_WRITE | CFS_APPEND);
+
+  if (fd < 0){
+    printf("Loader: cannot write %s\n", LOADER_FILE);
+    return;
+  }
+
+  if (len > 0){
+    cfs_seek(fd, offset, CFS_SEEK_SET);
+    cfs_write(fd, data, len);
+  }
+  cfs_close(fd);
+
+  if (flag == RUDOLPH1_FLAG_LASTCHUNK){
+    printf("Loader: module of %d bytes received\n", offset + len);
+    module_size = offset + len;
+
+    if (!is_source)
+      process_poll(&loader_process);
+  }
+}
+
+
+//chunk asked by a neighbour
+static int read_chunk(struct rudolph1_conn *c, int offset, uint8_t *to,
+                                                                int maxsize){
+  int fd, len;
+
+  fd = cfs_open(LOADER_FILE, CFS_READ);
+  if (fd < 0)
+    return 0;
+
+  cfs_seek(fd, offset, CFS_SEEK_SET);
+  len = cfs_read(fd, to, maxsize);
+  cfs_close(fd);
+
+  return (len < 0)?0:len;
+}
+
+static const struct rudolph1_callbacks rudolph_calls = {write_chunk,
+                                                                  read_chunk};
+
+
+/*******************************************************************************
+  link the module in LOADER_FILE and start its processes, after stopping the
+  ones of the module before (its memory is reused)
+*******************************************************************************/
+static void load_module(void){
+  int fd, ret;
+
+  if (elfloader_autostart_processes != NULL)
+    autostart_exit(elfloader_autostart_processes);
+
+  fd = cfs_open(LOADER_FILE, CFS_READ);
+  if (fd < 0){
+    printf("Loader: no module\n");
+    return;
+  }
+
+  ret = elfloader_load(fd);
+  cfs_close(fd);
+
+  switch (ret){
+    case ELFLOADER_OK:
+      printf("Loader: module loaded\n");
+      autostart_start(elfloader_autostart_processes);
+      break;
+    case ELFLOADER_SYMBOL_NOT_FOUND:
+      //built against another image
+      printf("Loader: symbol %s not found\n", elfloader_unknown);
+      break;
+    default:
+      printf("Loader: module not loaded, error %d\n", ret);
+  }
+}
+
+
+PROCESS_THREAD(loader_process, ev, data){
+  PROCESS_BEGIN();
+
+  while(1){
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    load_module();
+  }
+
+  PROCESS_END();
+}
+
+
+void loader_open(int source){
+  is_source = source;
+  module_size = 0;
+
+  if (!source){
+    elfloader_init();
+    process_start(&loader_process, NULL);
+  }
+
+  rudolph1_open(&rudolph, LOADER_CHANNEL, &rudolph_calls);
+}
+
+
+void loader_begin(void){
+  cfs_remove(LOADER_FILE);
+  module_size = 0;
+}
+
+
+long loader_append(const uint8_t *data, uint8_t len){
+  int fd;
+
+  fd = cfs_open(LOADER_FILE, CFS_WRITE | CFS_APPEND);
+  if (fd < 0)
+    return -1;
+
+  if (cfs_write(fd, data, len) != len){
+    cfs_close(fd);
+    return -1;
+  }
+  cfs_close(fd);
+
+  module_size += len;
+
+  return module_size;
+}
+
+
+int loader_publish(void){
+  if (module_size == 0)
+    return -1;
+
+  printf("Loader: publishing a module of %ld bytes\n", module_size);
+  rudolph1_send(&rudolph, LOADER_SEND_INTERVAL);
+
+  return 0;
+}
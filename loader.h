@@ -0,0 +1,57 @@
+#ifndef LOADER_H_
+#define LOADER_H_
+
+#include "contiki.h"
+
+/*******************************************************************************
+  Loadable modules: new behaviour for the nodes without reflashing the image.
+
+  A module is an ELF object (make TARGET=sky <module>.ce) with its own
+  AUTOSTART_PROCESSES. It is linked on the node by the elfloader of Contiki
+  against the symbol table of the image, so the image has to carry its table:
+  it is generated by a second build of the image against the first one
+  (make TARGET=sky Node1.symbols, see the Makefile). The symbols of a module
+  are resolved by name: a module that uses only the symbols of both Node1 and
+  Node2 runs on both.
+
+  The CU receives the module on the serial line (see console.h), stores it in
+  LOADER_FILE and disseminates it with Rime rudolph1 on LOADER_CHANNEL: every
+  node stores the chunks in its own LOADER_FILE and serves them to its
+  neighbours, so the module reaches the whole network. A node that has the
+  whole module stops the processes of the module before, links the new one
+  and starts its processes. A node that reboots gets the module again from
+  its neighbours, that advertise a newer version.
+*******************************************************************************/
+
+//rudolph1 uses 2 channels
+#define LOADER_CHANNEL 141
+
+#define LOADER_FILE "module.ce"
+
+//time between two chunks sent by the CU
+#ifndef LOADER_SEND_INTERVAL
+#define LOADER_SEND_INTERVAL CLOCK_SECOND
+#endif
+
+/*
+  join the dissemination of the modules. The source (the CU) stores the
+  modules but does not run them
+*/
+void loader_open(int source);
+
+//CU only: start a new module in LOADER_FILE
+void loader_begin(void);
+
+/*
+  CU only: append len bytes to the module. Return its size, -1 if the file
+  cannot be written
+*/
+long loader_append(const uint8_t *data, uint8_t len);
+
+/*
+  CU only: disseminate the module written so far as a new version. Return -1
+  if there is no module
+*/
+int loader_publish(void);
+
+#endif /* LOADER_H_ */
@@ -0,0 +1,135 @@
+#include <string.h>
+#include "message.h"
+#include "net/packetbuf.h"
+
+static uint8_t next_seqno = 0;
+//the commands have their own counter: the reports of the CU do not move the
+//window of the duplicate suppression of the nodes (see dedup.h)
+static uint8_t next_command_seqno = 0;
+
+
+uint8_t msg_begin(uint8_t opcode, uint8_t flags){
+  uint8_t *hdr;
+
+  packetbuf_clear();
+  hdr = (uint8_t*)packetbuf_dataptr();
+
+  hdr[0] = (MSG_VERSION << 4) | (flags & 0x0f);
+  hdr[1] = opcode;
+  hdr[2] = (opcode == MSG_OP_COMMAND)?next_command_seqno++:next_seqno++;
+
+  packetbuf_set_datalen(MSG_HDR_LEN);
+
+  return hdr[2];
+}
+
+
+int msg_append(uint8_t type, const void *value, uint8_t len){
+  uint16_t datalen = packetbuf_datalen();
+  uint8_t *pos;
+
+  if (datalen + MSG_TLV_HDR_LEN + len > PACKETBUF_SIZE)
+    return -1;
+
+  pos = (uint8_t*)packetbuf_dataptr() + datalen;
+  pos[0] = type;
+  pos[1] = len;
+  if (len > 0)
+    memcpy(pos + MSG_TLV_HDR_LEN, value, len);
+
+  packetbuf_set_datalen(datalen + MSG_TLV_HDR_LEN + len);
+
+  return 0;
+}
+
+
+int msg_append_u8(uint8_t type, uint8_t value){
+  return msg_append(type, &value, 1);
+}
+
+
+int msg_append_int16(uint8_t type, int16_t value){
+  uint8_t buf[2];
+
+  msg_put_u16(buf, (uint16_t)value);
+
+  return msg_append(type, buf, 2);
+}
+
+
+int msg_open(struct msg_reader *reader){
+  const uint8_t *hdr = (const uint8_t*)packetbuf_dataptr();
+  uint16_t datalen = packetbuf_datalen();
+
+  if (datalen < MSG_HDR_LEN)
+    return -1;
+
+  reader->version = hdr[0] >> 4;
+  reader->flags = hdr[0] & 0x0f;
+  reader->opcode = hdr[1];
+  reader->seqno = hdr[2];
+  reader->pos = hdr + MSG_HDR_LEN;
+  reader->end = hdr + datalen;
+
+  if (reader->version != MSG_VERSION)
+    return -1;
+
+  return 0;
+}
+
+
+int msg_next(struct msg_reader *reader, struct msg_tlv *tlv){
+  if (reader->pos >= reader->end)
+    return 0;
+
+  if (reader->end - reader->pos < MSG_TLV_HDR_LEN)
+    return -1;
+
+  tlv->type = reader->pos[0];
+  tlv->len = reader->pos[1];
+  tlv->value = reader->pos + MSG_TLV_HDR_LEN;
+
+  if (reader->end - tlv->value < tlv->len)
+    return -1;
+
+  reader->pos = tlv->value + tlv->len;
+
+  return 1;
+}
+
+
+uint16_t msg_epoch(const struct msg_reader *reader){
+  struct msg_reader r = *reader;
+  struct msg_tlv tlv;
+
+  while (msg_next(&r, &tlv) > 0)
+    if (tlv.type == MSG_TLV_EPOCH && tlv.len == 2)
+      return msg_get_u16(tlv.value);
+
+  return 0;
+}
+
+
+uint8_t msg_tlv_u8(const struct msg_tlv *tlv){
+  return (tlv->len >= 1)?tlv->value[0]:0;
+}
+
+
+int16_t msg_tlv_int16(const struct msg_tlv *tlv){
+  if (tlv->len < 2)
+    return 0;
+
+  return (int16_t)msg_get_u16(tlv->value);
+}
+
+
+void msg_put_u16(uint8_t *buf, uint16_t value){
+  //little endian on the air, whatever the cpu
+  buf[0] = value & 0xff;
+  buf[1] = value >> 8;
+}
+
+
+uint16_t msg_get_u16(const uint8_t *buf){
+  return buf[0] | ((uint16_t)buf[1] << 8);
+}
@@ -0,0 +1,173 @@
+#ifndef MESSAGE_H_
+#define MESSAGE_H_
+
+#include "contiki.h"
+
+/*******************************************************************************
+  Wire format shared by the Central Unit and every node.
+
+  Every frame starts with a 3 bytes header followed by a TLV body:
+
+    byte 0      version (high nibble) | flags (low nibble)
+    byte 1      opcode (MSG_OP_*)
+    byte 2      sequence number (a counter for the commands, one for the rest)
+    byte 3..    TLV entries: type (1 byte), length (1 byte), value
+
+  The frame is built and parsed in place on the packetbuf, so no extra copy is
+  needed before runicast_send/broadcast_send or inside the recv callbacks.
+*******************************************************************************/
+
+#define MSG_VERSION 1
+
+#define MSG_HDR_LEN 3
+#define MSG_TLV_HDR_LEN 2
+
+//opcodes
+#define MSG_OP_COMMAND 1
+#define MSG_OP_REPLY   2
+#define MSG_OP_ERROR   3
+#define MSG_OP_STATS   4
+#define MSG_OP_PUSH    5    //reading pushed by a subscribed node
+#define MSG_OP_STATE   6    //state vector disseminated with Trickle
+#define MSG_OP_ANNOUNCE 7   //capabilities of a node, to the CU over collect
+
+/*
+  TLV types. The command types keep the numbers of the user commands so that
+  the menu of the CU and the frame on the air use the same code. ALARM, GATE
+  and EXTENSION change the state of the house: on the air they become a STATE
+  entry with the new vector (see statesync.h)
+*/
+#define MSG_CMD_ALARM       1
+#define MSG_CMD_GATE        2
+#define MSG_CMD_OPEN        3
+#define MSG_CMD_TEMPERATURE 4
+#define MSG_CMD_LIGHT       5
+#define MSG_CMD_EXTENSION   6
+
+//OPEN carries the network time of the start (uint16, see schedule.h)
+#define MSG_OPEN_LEN        2
+
+/*
+  telemetry subscription (not in the menu). SUBSCRIBE carries the reading
+  (uint8 MSG_TLV_TEMPERATURE/LIGHT), the delta (int16) and the max interval in
+  seconds (uint16) between two pushes, UNSUBSCRIBE only the reading
+*/
+#define MSG_CMD_SUBSCRIBE   7
+#define MSG_CMD_UNSUBSCRIBE 8
+#define MSG_SUBSCRIBE_LEN   5
+
+/*
+  statistics of the temperature history of the door node (see history.h)
+  between from and to minutes ago (uint16 each); without the window it is the
+  last hour
+*/
+#define MSG_CMD_HISTORY     9
+#define MSG_HISTORY_LEN     4
+
+//upload the series of samples not sent yet (see series.h and bulk.h)
+#define MSG_CMD_UPLOAD      10
+
+//measurements (int16 value)
+#define MSG_TLV_TEMPERATURE 0x10
+#define MSG_TLV_LIGHT       0x11
+//temperature history: samples (uint16), mean, min, max (int16 each)
+#define MSG_TLV_HISTORY     0x12
+#define MSG_TLV_HISTORY_LEN 8
+//series of samples (see series.h), with the multi-hop transport only
+#define MSG_TLV_SERIES      0x13
+//error report (uint8 value, MSG_ERR_*)
+#define MSG_TLV_ERROR       0x20
+/*
+  group command (see groupack.h): the GROUP entry lists the addresses of the
+  members (2 bytes each), the ACK of a member carries the sequence number of
+  the command, the position of the member in the list and its status (0 or
+  MSG_ERR_*, a NACK)
+*/
+#define MSG_TLV_GROUP       0x21
+#define MSG_TLV_ACK         0x22
+/*
+  state vector of the house (see statesync.h): version (uint16), alarm, gate
+  locked, extension active (uint8 each)
+*/
+#define MSG_TLV_STATE       0x23
+//capabilities of the node (uint16 DISCOVERY_CAP_*, see discovery.h)
+#define MSG_TLV_CAPS        0x24
+//boot counter of the CU (uint16, never 0), in every command frame: the
+//nodes restart their duplicate window when it changes (see dedup.h)
+#define MSG_TLV_EPOCH       0x25
+
+//energy report (5 uint16 values, ms spent since the last report: period,
+//cpu, lpm, tx, listen)
+#define MSG_TLV_ENERGEST    0x30
+//active time of an application (uint8 STATS_APP_*, uint16 ms)
+#define MSG_TLV_APP_TIME    0x31
+//route of the node with the multi-hop transport (parent address, uint16 ETX
+//of the path to the CU, uint16 ETX of the link to the parent, in units of
+//COLLECT_LINK_ESTIMATE_UNIT)
+#define MSG_TLV_ROUTE       0x32
+//send queue of the replies to the CU (uint8 frames waiting now, uint8 highest
+//number of frames waiting, uint16 frames that had to wait, uint16 frames
+//dropped, since the boot)
+#define MSG_TLV_QUEUE       0x33
+#define MSG_TLV_QUEUE_LEN   6
+
+//error codes
+#define MSG_ERR_ALARM_REFUSED 1   //node 1.0 refuses to activate the alarm
+
+struct msg_tlv {
+  uint8_t type;
+  uint8_t len;
+  const uint8_t *value;
+};
+
+struct msg_reader {
+  uint8_t version;
+  uint8_t flags;
+  uint8_t opcode;
+  uint8_t seqno;
+  const uint8_t *pos;
+  const uint8_t *end;
+};
+
+/*
+  clear the packetbuf and write a new header. The sequence number is taken
+  from a per-node counter and returned: MSG_OP_COMMAND has its own counter,
+  so the frames that are not commands do not make the one of the commands
+  wrap around
+*/
+uint8_t msg_begin(uint8_t opcode, uint8_t flags);
+
+/*
+  append a TLV entry to the frame in the packetbuf. Return 0 on success, -1 if
+  the entry does not fit
+*/
+int msg_append(uint8_t type, const void *value, uint8_t len);
+int msg_append_u8(uint8_t type, uint8_t value);
+int msg_append_int16(uint8_t type, int16_t value);
+
+/*
+  validate the header of the frame in the packetbuf and prepare the reader.
+  Return 0 on success, -1 if the frame is too short or has another version
+*/
+int msg_open(struct msg_reader *reader);
+
+/*
+  fetch the next TLV entry. Return 1 if an entry is available, 0 at the end of
+  the frame, -1 if the entry is truncated
+*/
+int msg_next(struct msg_reader *reader, struct msg_tlv *tlv);
+
+/*
+  the MSG_TLV_EPOCH entry of the frame, 0 if there is none. The reader is not
+  moved
+*/
+uint16_t msg_epoch(const struct msg_reader *reader);
+
+uint8_t msg_tlv_u8(const struct msg_tlv *tlv);
+int16_t msg_tlv_int16(const struct msg_tlv *tlv);
+
+//little endian helpers for the values made of several fields
+void msg_put_u16(uint8_t *buf, uint16_t value);
+uint16_t msg_get_u16(const uint8_t *buf);
+
+#endif /* MESSAGE_H_ */
@@ -0,0 +1,12 @@
+#ifndef LIGHT_SENSOR_H_
+#define LIGHT_SENSOR_H_
+
+#include "lib/sensors.h"
+
+//native stub of the sky light sensor (see native/sensors-stub.c)
+extern const struct sensors_sensor light_sensor;
+
+#define LIGHT_SENSOR_PHOTOSYNTHETIC 0
+#define LIGHT_SENSOR_TOTAL_SOLAR    1
+
+#endif /* LIGHT_SENSOR_H_ */
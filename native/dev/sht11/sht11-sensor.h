@@ -0,0 +1,13 @@
+#ifndef SHT11_SENSOR_H_
+#define SHT11_SENSOR_H_
+
+#include "lib/sensors.h"
+
+//native stub of the SHT11 (see native/sensors-stub.c)
+extern const struct sensors_sensor sht11_sensor;
+
+#define SHT11_SENSOR_TEMP              0
+#define SHT11_SENSOR_HUMIDITY          1
+#define SHT11_SENSOR_BATTERY_INDICATOR 2
+
+#endif /* SHT11_SENSOR_H_ */
@@ -0,0 +1,14 @@
+#ifndef Z1_PHIDGETS_H_
+#define Z1_PHIDGETS_H_
+
+#include "lib/sensors.h"
+
+//native stub of the phidgets ADC inputs (see native/sensors-stub.c)
+extern const struct sensors_sensor phidgets;
+
+#define PHIDGET5V_1 0
+#define PHIDGET5V_2 1
+#define PHIDGET3V_1 2
+#define PHIDGET3V_2 3
+
+#endif /* Z1_PHIDGETS_H_ */
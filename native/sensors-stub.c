@@ -0,0 +1,55 @@
+/*******************************************************************************
+  Stub sensors for TARGET=native: the SHT11, the light sensor and the phidgets
+  return raw values close to the ones of a quiet room at 24 degrees, with some
+  noise, so that the firmware runs unchanged on a Linux box.
+*******************************************************************************/
+#include "contiki.h"
+#include "lib/random.h"
+#include "dev/sht11/sht11-sensor.h"
+#include "dev/light-sensor.h"
+#include "dev/z1-phidgets.h"
+
+static int active = 0;
+
+
+static int configure(int type, int value){
+  if (type == SENSORS_ACTIVE)
+    active = value;
+
+  return 1;
+}
+
+
+static int status(int type){
+  return active;
+}
+
+
+static int sht11_value(int type){
+  switch (type){
+    case SHT11_SENSOR_TEMP:
+      //(raw/10-396)/10 = 24 degrees, +/-1
+      return 6360 + (random_rand() % 200) - 100;
+    case SHT11_SENSOR_HUMIDITY:
+      return 1200;
+    default:
+      return 0;
+  }
+}
+
+
+static int light_value(int type){
+  //10*raw/7 = about 200 lux
+  return 140 + (random_rand() % 20);
+}
+
+
+static int phidgets_value(int type){
+  //quiet room: a few mV, below the 20 dB threshold
+  return random_rand() % 8;
+}
+
+
+SENSORS_SENSOR(sht11_sensor, "sht11", sht11_value, configure, status);
+SENSORS_SENSOR(light_sensor, "Light", light_value, configure, status);
+SENSORS_SENSOR(phidgets, "Phidgets", phidgets_value, configure, status);
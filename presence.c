@@ -0,0 +1,60 @@
+#include "presence.h"
+
+
+void presence_init(struct presence *p){
+  p->human_sensed = 0;
+  p->noise_time = 0;
+  p->silence_time = 0;
+}
+
+
+int presence_update(struct presence *p, int db, clock_time_t elapsed){
+  if (db<=DB_THRESHOLD && p->human_sensed){
+    p->silence_time += elapsed;
+    p->noise_time = 0;
+
+    if (p->silence_time >= TIME_TO_DEACTIVATE){
+      p->silence_time = 0;
+      //there is none in the room
+      p->human_sensed = 0;
+      return PRESENCE_LEFT;
+    }
+  }
+
+  if (db>DB_THRESHOLD && !p->human_sensed){
+    p->noise_time += elapsed;
+    p->silence_time = 0;
+
+    if (p->noise_time >= TIME_TO_ACTIVATE){
+      p->noise_time = 0;
+      //someone is inside the room
+      p->human_sensed = 1;
+      return PRESENCE_ARRIVED;
+    }
+  }
+
+  //the state is confirmed: a change has to start again from zero
+  if (db>DB_THRESHOLD && p->human_sensed)
+    p->silence_time = 0;
+  if (db<=DB_THRESHOLD && !p->human_sensed)
+    p->noise_time = 0;
+
+  return PRESENCE_UNCHANGED;
+}
+
+
+clock_time_t presence_next_interval(const struct presence *p,
+                                            clock_time_t interval, int db){
+  if (p->noise_time > 0 || p->silence_time > 0 ||
+      (db > DB_THRESHOLD - SENSING_GUARD_DB &&
+                                      db <= DB_THRESHOLD + SENSING_GUARD_DB))
+    //something could change soon
+    return SENSING_MIN_INTERVAL;
+
+  //the room is stable: back off
+  interval *= 2;
+  if (interval > SENSING_MAX_INTERVAL)
+    interval = SENSING_MAX_INTERVAL;
+
+  return interval;
+}
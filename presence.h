@@ -0,0 +1,54 @@
+#ifndef PRESENCE_H_
+#define PRESENCE_H_
+
+#include "contiki.h"
+
+/*******************************************************************************
+  Presence detection of the extension node, without any access to the sensors:
+  hysteresis on the sound level and adaptive sampling interval.
+
+  The presence state changes after TIME_TO_ACTIVATE of continuous noise or
+  TIME_TO_DEACTIVATE of continuous silence. The counters are in time, not in
+  samples, because the sampling interval changes: it doubles at every sample
+  while the room is stable, up to SENSING_MAX_INTERVAL, and goes back to
+  SENSING_MIN_INTERVAL as soon as a reading is within SENSING_GUARD_DB from the
+  threshold or a change of state is in progress. A change is detected at most
+  SENSING_MAX_INTERVAL later than with a fixed 1 second period.
+*******************************************************************************/
+
+//someone is in the room when the noise is above this level
+#define DB_THRESHOLD 20
+//time of continuous noise/silence needed to change the presence state
+#define TIME_TO_DEACTIVATE (CLOCK_SECOND*120)
+#define TIME_TO_ACTIVATE (CLOCK_SECOND*30)
+
+#define SENSING_MIN_INTERVAL CLOCK_SECOND
+#define SENSING_MAX_INTERVAL (CLOCK_SECOND*8)
+#define SENSING_GUARD_DB 6
+
+struct presence {
+  int human_sensed;
+  //time of noise (silence) observed so far
+  clock_time_t noise_time;
+  clock_time_t silence_time;
+};
+
+//result of presence_update
+enum {
+  PRESENCE_UNCHANGED,
+  PRESENCE_ARRIVED,     //someone entered the room
+  PRESENCE_LEFT         //there is none in the room anymore
+};
+
+void presence_init(struct presence *p);
+
+/*
+  account a sample of db dB taken elapsed ticks after the previous one
+*/
+int presence_update(struct presence *p, int db, clock_time_t elapsed);
+
+//interval before the next sample
+clock_time_t presence_next_interval(const struct presence *p,
+                                            clock_time_t interval, int db);
+
+#endif /* PRESENCE_H_ */
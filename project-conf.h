@@ -1,4 +1,234 @@
 #ifndef PROJECT_CONF_H_
 #define PROJECT_CONF_H_
 
-#endif /* PROJECT_CONF_H_ */
\ No newline at end of file
+/*******************************************************************************
+  Radio profile.
+
+  Every node must run the same RDC, otherwise the frames sent by a node are not
+  understood by the others: the role of the node (mains powered CU or battery
+  powered node) is chosen at run time.
+    - lowpower (default): ContikiMAC on every node. The CU keeps its radio on
+      (CU_CONF_RADIO_ALWAYS_ON), while Node1, Node2 and the extension node
+      sleep and check the channel NETSTACK_CONF_RDC_CHANNEL_CHECK_RATE times
+      per second.
+    - alwayson (make RADIO_PROFILE=alwayson): nullrdc on every node, useful as
+      a reference when measuring latency and energy.
+*******************************************************************************/
+
+#ifndef RADIO_CONF_ALWAYS_ON
+#define RADIO_CONF_ALWAYS_ON 0
+#endif
+
+/*
+  max latency (ms) that the duty cycle may add to a command on each hop: in the
+  worst case the sender has to wait a whole cycle for the wake-up of the
+  receiver
+*/
+#ifndef COMMAND_LATENCY_BOUND_MS
+#define COMMAND_LATENCY_BOUND_MS 250
+#endif
+
+#undef NETSTACK_CONF_MAC
+#define NETSTACK_CONF_MAC csma_driver
+
+#if RADIO_CONF_ALWAYS_ON
+
+#undef NETSTACK_CONF_RDC
+#define NETSTACK_CONF_RDC nullrdc_driver
+
+#define CU_CONF_RADIO_ALWAYS_ON 0
+
+#else /* RADIO_CONF_ALWAYS_ON */
+
+#undef NETSTACK_CONF_RDC
+#define NETSTACK_CONF_RDC contikimac_driver
+
+//channel checks per second (power of two): lower rate, lower energy
+#undef NETSTACK_CONF_RDC_CHANNEL_CHECK_RATE
+#define NETSTACK_CONF_RDC_CHANNEL_CHECK_RATE 8
+
+#if (1000 / NETSTACK_CONF_RDC_CHANNEL_CHECK_RATE) > COMMAND_LATENCY_BOUND_MS
+#error "The channel check rate is too low for COMMAND_LATENCY_BOUND_MS"
+#endif
+
+/*
+  phase-lock: the sender learns the wake-up time of each neighbour from the
+  acks and starts the strobe right before it, so the unicasts of the CU to 1.0
+  and 2.0 land on the wake-up of the receiver instead of strobing a whole cycle
+*/
+#undef CONTIKIMAC_CONF_WITH_PHASE_OPTIMIZATION
+#define CONTIKIMAC_CONF_WITH_PHASE_OPTIMIZATION 1
+
+//the CU is mains powered: no duty cycle, so it never misses a frame
+#define CU_CONF_RADIO_ALWAYS_ON 1
+
+#endif /* RADIO_CONF_ALWAYS_ON */
+
+/*
+  Link-layer security (make SECURITY=0 to disable it). Every frame is
+  encrypted and authenticated with AES-CCM* (ENC-MIC-64) by noncoresec, with a
+  key shared by the whole network, and carries a frame counter: a frame with a
+  counter not newer than the last one heard from the same neighbour is a
+  replay and is dropped. The AES runs on the CC2420, not in software
+  (make LLSEC_HW_AES=0 for a simulator without it).
+
+  The key is not in the repository: make LLSEC_KEY=0x..,0x..,... (16 bytes).
+  There is no default key, a build without it fails; the simulation passes a
+  public test key (see simulation/).
+
+  The neighbours never forget the last counter of a node: a node that
+  counted again from 0 after a reboot would be deaf to them for hours or
+  days. The counter is kept on the flash instead (see anti-replay.c). If the
+  external flash of a node is erased its counter starts again from 0: reboot
+  its neighbours (the whole network, for the CU) so they forget the old one.
+
+  The netstack is part of the contiki library: run make clean after changing
+  these options
+*/
+#ifndef LLSEC_CONF_ENABLED
+#define LLSEC_CONF_ENABLED 1
+#endif
+#ifndef LLSEC_CONF_HW_AES
+#define LLSEC_CONF_HW_AES 1
+#endif
+
+#if LLSEC_CONF_ENABLED
+#undef LLSEC802154_CONF_ENABLED
+#define LLSEC802154_CONF_ENABLED 1
+#undef NETSTACK_CONF_LLSEC
+#define NETSTACK_CONF_LLSEC noncoresec_driver
+#undef NONCORESEC_CONF_SEC_LVL
+#define NONCORESEC_CONF_SEC_LVL 6
+
+//the frames of Rime keep the ContikiMAC framer, around the secured one
+#undef NETSTACK_CONF_FRAMER
+#define NETSTACK_CONF_FRAMER contikimac_framer
+#undef CONTIKIMAC_FRAMER_CONF_DECORATED_FRAMER
+#define CONTIKIMAC_FRAMER_CONF_DECORATED_FRAMER noncoresec_framer
+
+#if LLSEC_CONF_HW_AES
+#undef AES_128_CONF
+#define AES_128_CONF cc2420_aes_128_driver
+#endif
+
+#ifndef NONCORESEC_CONF_KEY
+#error "No network key: make LLSEC_KEY=0x..,...(16 bytes), or SECURITY=0"
+#endif
+#endif /* LLSEC_CONF_ENABLED */
+
+/*
+  the broadcast of the CU to the extension nodes has no ack: it is sent
+  COMMAND_REPEAT more times, the nodes drop the copies (see dedup.h)
+*/
+#ifndef COMMAND_REPEAT
+#define COMMAND_REPEAT 2
+#endif
+
+/*
+  network time (see schedule.h): the nodes synchronise their rtimer with the
+  CU from the timestamps of the CC2420. 0: every node uses its own clock
+*/
+#ifndef SCHEDULE_CONF_TIMESYNCH
+#define SCHEDULE_CONF_TIMESYNCH 1
+#endif
+
+#if SCHEDULE_CONF_TIMESYNCH
+#undef TIMESYNCH_CONF_ENABLED
+#define TIMESYNCH_CONF_ENABLED 1
+#undef CC2420_CONF_TIMESTAMPS
+#define CC2420_CONF_TIMESTAMPS 1
+#endif
+
+//multi-hop transport (transport.h), make TRANSPORT=multihop
+#ifndef TRANSPORT_CONF_MULTIHOP
+#define TRANSPORT_CONF_MULTIHOP 0
+#endif
+
+/*
+  number of nodes of the network, the CU excluded: the CU has an entry for
+  each of them in its discovery table (discovery.h). make NETWORK_SIZE=...
+*/
+#ifndef NETWORK_CONF_SIZE
+#define NETWORK_CONF_SIZE 16
+#endif
+
+//number of temperature samples averaged by Node1 (one every 10 seconds)
+#ifndef TEMPERATURE_WINDOW
+#define TEMPERATURE_WINDOW 5
+#endif
+
+/*
+  temperature history of Node1 on the flash (history.h). The segments are
+  reserved with Coffee; 0 for a file system without cfs_coffee_reserve (the
+  POSIX one of the native target)
+*/
+#ifndef HISTORY_CONF_COFFEE
+#define HISTORY_CONF_COFFEE 1
+#endif
+
+/*
+  series of the samples of Node1 and Node2 (series.h), uploaded in bulk to the
+  CU when full or on demand. With the multi-hop transport a series travels in
+  a single frame
+*/
+#ifndef SERIES_SIZE
+#if TRANSPORT_CONF_MULTIHOP
+#define SERIES_SIZE 64
+#else
+#define SERIES_SIZE 180
+#endif
+#endif
+
+/*
+  push telemetry (telemetry.h): the CU subscribes to the readings of Node1 and
+  Node2, that push them when they change by at least the delta or every
+  TELEMETRY_MAX_INTERVAL seconds. 0: the CU polls the nodes
+*/
+#ifndef TELEMETRY_CONF_PUSH
+#define TELEMETRY_CONF_PUSH 1
+#endif
+#ifndef TELEMETRY_TEMPERATURE_DELTA
+#define TELEMETRY_TEMPERATURE_DELTA 1
+#endif
+#ifndef TELEMETRY_LIGHT_DELTA
+#define TELEMETRY_LIGHT_DELTA 20
+#endif
+#ifndef TELEMETRY_MAX_INTERVAL
+#define TELEMETRY_MAX_INTERVAL 120
+#endif
+
+/*
+  cache of the CU (sensorcache.h): a reading older than SENSOR_CACHE_MAX_AGE
+  seconds is refreshed, every SENSOR_CACHE_REFRESH_PERIOD seconds the stale
+  readings are refreshed in background (0: only when the user asks for them).
+  With push telemetry a reading is valid until the next push is due
+*/
+#ifndef SENSOR_CACHE_MAX_AGE
+#if TELEMETRY_CONF_PUSH
+#define SENSOR_CACHE_MAX_AGE (TELEMETRY_MAX_INTERVAL + 20)
+#else
+#define SENSOR_CACHE_MAX_AGE 30
+#endif
+#endif
+#ifndef SENSOR_CACHE_REFRESH_PERIOD
+#define SENSOR_CACHE_REFRESH_PERIOD 120
+#endif
+
+/*
+  sound sensing of the extension node (burst.h): a burst of BURST_SAMPLES
+  samples instead of a single one. The samples are taken from the rtimer when
+  it is not used by the radio duty cycle (SENSING_CONF_RTIMER), otherwise in a
+  loop paced by the rtimer clock
+*/
+#ifndef SENSING_CONF_BURST
+#define SENSING_CONF_BURST 1
+#endif
+#ifndef SENSING_CONF_RTIMER
+#define SENSING_CONF_RTIMER RADIO_CONF_ALWAYS_ON
+#endif
+
+//energy accounting (stats.c)
+#undef ENERGEST_CONF_ON
+#define ENERGEST_CONF_ON 1
+
+#endif /* PROJECT_CONF_H_ */
@@ -0,0 +1,82 @@
+#include "contiki.h"
+#if SCHEDULE_CONF_TIMESYNCH
+#include "net/rime/timesynch.h"
+#endif
+#include "stdio.h"
+#include "schedule.h"
+
+static void (*scheduled_action)(void);
+
+#if SCHEDULE_CONF_RTIMER
+static struct rtimer schedule_rtimer;
+
+PROCESS(schedule_process, "Schedule process");
+
+/*
+  the rtimer runs in interrupt context: the action is run by the process
+*/
+static void fire(struct rtimer *t, void *ptr){
+  process_poll(&schedule_process);
+}
+
+
+PROCESS_THREAD(schedule_process, ev, data){
+  PROCESS_BEGIN();
+
+  while(1){
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    scheduled_action();
+  }
+
+  PROCESS_END();
+}
+#else
+static struct ctimer schedule_timer;
+
+static void fire(void *ptr){
+  scheduled_action();
+}
+#endif
+
+
+rtimer_clock_t schedule_now(void){
+#if SCHEDULE_CONF_TIMESYNCH
+  return timesynch_time();
+#else
+  return RTIMER_NOW();
+#endif
+}
+
+
+int schedule_at(rtimer_clock_t start, void (*action)(void)){
+  int16_t wait;
+
+#if !SCHEDULE_CONF_TIMESYNCH
+  //the clock of the CU is not the one of this node
+  start = schedule_now() + SCHEDULE_LEAD;
+#endif
+
+  //ticks to the start: negative if it is over
+  wait = (int16_t)(start - schedule_now());
+
+  scheduled_action = action;
+
+  if (wait <= 0){
+    printf("Scheduled action late by %u ticks, started at once\n",
+                                                          (uint16_t)-wait);
+    action();
+    return -1;
+  }
+
+#if SCHEDULE_CONF_RTIMER
+  process_start(&schedule_process, NULL);
+  //start in the local clock
+  rtimer_set(&schedule_rtimer, RTIMER_NOW() + wait, 1, fire, NULL);
+#else
+  //rounded up, never before the instant
+  ctimer_set(&schedule_timer, ((unsigned long)wait * CLOCK_SECOND + 
+                          RTIMER_SECOND - 1) / RTIMER_SECOND, fire, NULL);
+#endif
+
+  return 0;
+}
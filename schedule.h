@@ -0,0 +1,47 @@
+#ifndef SCHEDULE_H_
+#define SCHEDULE_H_
+
+#include "contiki.h"
+
+/*******************************************************************************
+  Actions scheduled at a network time.
+
+  The CU is the authority of the Rime time synchronisation (timesynch.h): the
+  nodes align their rtimer to its clock from the timestamps of the radio, so
+  the network time (timesynch_time(), rtimer ticks) is the same on every node.
+  The CU picks the instant when an action has to start, SCHEDULE_LEAD after
+  the command, and every node starts it at that instant, whatever the delay
+  the MAC has added to the frame.
+
+  The network time has 16 bits: an instant is valid for half of the range, so
+  SCHEDULE_LEAD must be shorter than that (one second on the sky). A frame
+  that arrives after the instant (a retransmission, a long route) runs the
+  action at once.
+
+  Without SCHEDULE_CONF_TIMESYNCH (TARGET=native) every node uses its own
+  clock: the actions start SCHEDULE_LEAD after the command.
+
+  The action runs from an rtimer when the rtimer is free
+  (SCHEDULE_CONF_RTIMER, the default with RADIO_CONF_ALWAYS_ON): ContikiMAC
+  keeps the only rtimer of the platform for its duty cycle, so with it the
+  wait is converted to a ctimer, with the precision of a clock tick.
+*******************************************************************************/
+
+//time between the command and the start of the action, in rtimer ticks
+#define SCHEDULE_LEAD (RTIMER_SECOND/4*3)
+
+#ifndef SCHEDULE_CONF_RTIMER
+#define SCHEDULE_CONF_RTIMER RADIO_CONF_ALWAYS_ON
+#endif
+
+//current network time
+rtimer_clock_t schedule_now(void);
+
+/*
+  run action at the network time start: a single action can be scheduled at a
+  time, a new one replaces it. Return 0 if the action has been scheduled, -1
+  if start is already over and the action has been run at once
+*/
+int schedule_at(rtimer_clock_t start, void (*action)(void));
+
+#endif /* SCHEDULE_H_ */
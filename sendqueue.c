@@ -0,0 +1,90 @@
+#include "sendqueue.h"
+#include "stdio.h"
+
+
+/*******************************************************************************
+  send the oldest queued frame if the connection is idle. It runs from a
+  ctimer and not directly inside the runicast callbacks, because there the
+  packetbuf still holds the ack and runicast has not finished with it
+*******************************************************************************/
+static void drain(void *ptr){
+  struct sendqueue *sq = (struct sendqueue*)ptr;
+  struct packetqueue_item *item;
+
+  if (runicast_is_transmitting(sq->conn) ||
+                                  linkaddr_cmp(&sq->receiver, &linkaddr_null))
+    return;
+
+  item = packetqueue_first(sq->queue);
+  if (item == NULL)
+    return;
+
+  //copy the frame back in the packetbuf before freeing the queuebuf
+  queuebuf_to_packetbuf(packetqueue_queuebuf(item));
+  packetqueue_dequeue(sq->queue);
+
+  runicast_send(sq->conn, &sq->receiver, sq->max_retransmissions);
+}
+
+
+void sendqueue_init(struct sendqueue *sq, struct runicast_conn *conn,
+      struct packetqueue *queue, const linkaddr_t *receiver,
+      uint8_t max_retransmissions){
+  sq->conn = conn;
+  sq->queue = queue;
+  linkaddr_copy(&sq->receiver, receiver);
+  sq->max_retransmissions = max_retransmissions;
+
+  sq->max_depth = 0;
+  sq->queued = 0;
+  sq->dropped = 0;
+
+  packetqueue_init(queue);
+}
+
+
+int sendqueue_send(struct sendqueue *sq){
+  int depth;
+
+  if (!runicast_is_transmitting(sq->conn) &&
+                              packetqueue_first(sq->queue) == NULL &&
+                              !linkaddr_cmp(&sq->receiver, &linkaddr_null)){
+    runicast_send(sq->conn, &sq->receiver, sq->max_retransmissions);
+    return 0;
+  }
+
+  //no lifetime: the frame stays until the connection is free
+  if (!packetqueue_enqueue_packetbuf(sq->queue, 0, NULL)){
+    sq->dropped++;
+    printf("Send queue full: frame dropped (%d dropped)\n", sq->dropped);
+    return -1;
+  }
+
+  sq->queued++;
+  depth = packetqueue_len(sq->queue);
+  if (depth > sq->max_depth)
+    sq->max_depth = depth;
+
+  printf("Connection busy or receiver unknown: frame queued, queue depth %d\n",
+                                                                        depth);
+
+  return 0;
+}
+
+
+void sendqueue_set_receiver(struct sendqueue *sq, const linkaddr_t *receiver){
+  linkaddr_copy(&sq->receiver, receiver);
+
+  //the frames queued while the receiver was unknown can go
+  sendqueue_sent(sq);
+}
+
+
+void sendqueue_sent(struct sendqueue *sq){
+  ctimer_set(&sq->drain_timer, 0, drain, sq);
+}
+
+
+int sendqueue_depth(struct sendqueue *sq){
+  return packetqueue_len(sq->queue);
+}
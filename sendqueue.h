@@ -0,0 +1,60 @@
+#ifndef SENDQUEUE_H_
+#define SENDQUEUE_H_
+
+#include "contiki.h"
+#include "net/rime/rime.h"
+#include "net/packetqueue.h"
+
+/*******************************************************************************
+  Bounded outbound queue for a runicast connection.
+
+  A frame handed to sendqueue_send is transmitted immediately if the connection
+  is idle, otherwise it is copied in a queuebuf and waits in the packetqueue.
+  The queue is drained from the sent/timedout callbacks of the connection, so a
+  busy connection turns into latency instead of a lost reply. The receiver can
+  be linkaddr_null until it is known: the frames wait for it in the queue.
+*******************************************************************************/
+
+//default number of frames waiting for each connection
+#ifndef SENDQUEUE_SIZE
+#define SENDQUEUE_SIZE 4
+#endif
+
+struct sendqueue {
+  struct runicast_conn *conn;
+  struct packetqueue *queue;
+  linkaddr_t receiver;
+  uint8_t max_retransmissions;
+  struct ctimer drain_timer;
+
+  //stats, reported to the CU (see stats_watch_queue)
+  uint8_t max_depth;    //highest number of frames waiting at the same time
+  uint16_t queued;      //frames that had to wait for the connection
+  uint16_t dropped;     //frames refused because the queue was full
+};
+
+/*
+  the packetqueue is declared by the caller with PACKETQUEUE(name, size)
+*/
+void sendqueue_init(struct sendqueue *sq, struct runicast_conn *conn,
+      struct packetqueue *queue, const linkaddr_t *receiver,
+      uint8_t max_retransmissions);
+
+/*
+  send the frame in the packetbuf to the receiver of the queue. Return 0 if the
+  frame is sent or queued, -1 if the queue is full
+*/
+int sendqueue_send(struct sendqueue *sq);
+
+//change the receiver of the queue, and send the frames waiting for it
+void sendqueue_set_receiver(struct sendqueue *sq, const linkaddr_t *receiver);
+
+/*
+  to be called from the sent and timedout callbacks of the connection
+*/
+void sendqueue_sent(struct sendqueue *sq);
+
+//number of frames waiting
+int sendqueue_depth(struct sendqueue *sq);
+
+#endif /* SENDQUEUE_H_ */
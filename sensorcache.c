@@ -0,0 +1,49 @@
+#include "contiki.h"
+#include "sensorcache.h"
+
+
+void sensorcache_init(struct sensorcache *c){
+  c->value = 0;
+  c->timestamp = 0;
+  c->refresh_time = 0;
+  c->valid = 0;
+  c->refreshing = 0;
+}
+
+
+void sensorcache_update(struct sensorcache *c, int value){
+  c->value = value;
+  c->timestamp = clock_seconds();
+  c->valid = 1;
+  //the reading answers the refresh in flight, if any
+  c->refreshing = 0;
+}
+
+
+unsigned long sensorcache_age(const struct sensorcache *c){
+  return clock_seconds() - c->timestamp;
+}
+
+
+int sensorcache_lookup(const struct sensorcache *c, unsigned long max_age){
+  if (!c->valid)
+    return SENSORCACHE_MISS;
+
+  if (sensorcache_age(c) > max_age)
+    return SENSORCACHE_STALE;
+
+  return SENSORCACHE_FRESH;
+}
+
+
+int sensorcache_start_refresh(struct sensorcache *c){
+  //a refresh is on its way and could still be answered
+  if (c->refreshing &&
+          clock_seconds() - c->refresh_time < SENSORCACHE_REFRESH_TIMEOUT)
+    return 0;
+
+  c->refreshing = 1;
+  c->refresh_time = clock_seconds();
+
+  return 1;
+}
@@ -0,0 +1,57 @@
+#ifndef SENSORCACHE_H_
+#define SENSORCACHE_H_
+
+#include <stdint.h>
+
+/*******************************************************************************
+  Cache of a sensor reading kept by the CU (mean temperature of Node1, light of
+  Node2), with the time of the reading.
+
+  A request is answered at once from the cache (stale-while-revalidate):
+    - fresh entry: the cached value is the answer, nothing is sent
+    - stale entry: the cached value is printed as it is and a refresh is sent
+      to the node, the reply updates the entry
+    - empty entry: the node is asked, as before
+  At most one refresh per entry is in flight. A refresh never answered (lost
+  reply, runicast timeout) does not block the entry: a new one can start after
+  SENSORCACHE_REFRESH_TIMEOUT seconds.
+
+  Times are in seconds (clock_seconds()): the 16 bit clock_time of the sky
+  wraps after about 8 minutes, too early for the age of a reading.
+*******************************************************************************/
+
+#define SENSORCACHE_REFRESH_TIMEOUT 20
+
+struct sensorcache {
+  int value;
+  unsigned long timestamp;      //time of the reading
+  unsigned long refresh_time;   //time of the last refresh sent
+  uint8_t valid;
+  uint8_t refreshing;
+};
+
+//result of sensorcache_lookup
+enum {
+  SENSORCACHE_MISS,       //no reading yet
+  SENSORCACHE_FRESH,
+  SENSORCACHE_STALE
+};
+
+void sensorcache_init(struct sensorcache *c);
+
+//store a new reading (a reply or an update pushed by the node)
+void sensorcache_update(struct sensorcache *c, int value);
+
+//state of the entry, stale if older than max_age seconds
+int sensorcache_lookup(const struct sensorcache *c, unsigned long max_age);
+
+//age of the reading in seconds
+unsigned long sensorcache_age(const struct sensorcache *c);
+
+/*
+  return 1 if the caller has to send a refresh to the node (none in flight),
+  0 if a refresh is already on its way
+*/
+int sensorcache_start_refresh(struct sensorcache *c);
+
+#endif /* SENSORCACHE_H_ */
@@ -0,0 +1,126 @@
+#include "series.h"
+
+//3 bytes hold the zigzag of any difference of two int16
+#define VARINT_MAX_LEN 3
+
+
+static void put_u16(uint8_t *buf, uint16_t value){
+  buf[0] = value & 0xff;
+  buf[1] = value >> 8;
+}
+
+
+static uint16_t get_u16(const uint8_t *buf){
+  return buf[0] | (buf[1] << 8);
+}
+
+
+void series_init(struct series *s, uint8_t reading, uint16_t period){
+  s->block[0] = reading;
+  put_u16(s->block + 1, period);
+  series_reset(s);
+}
+
+
+void series_reset(struct series *s){
+  s->len = 0;
+  s->count = 0;
+  s->last = 0;
+}
+
+
+int series_add(struct series *s, int16_t value, unsigned long now){
+  uint8_t *pos = s->block + SERIES_HDR_LEN + s->len;
+  long delta = (long)value - s->last;
+  //zigzag: the sign goes to the lowest bit
+  unsigned long zigzag = (delta < 0)?((unsigned long)(-delta) << 1) - 1:
+                                      (unsigned long)delta << 1;
+
+  if (s->len + VARINT_MAX_LEN > SERIES_SIZE || s->count == 0xffff)
+    return -1;
+
+  while (zigzag >= 0x80){
+    *pos++ = (zigzag & 0x7f) | 0x80;
+    zigzag >>= 7;
+  }
+  *pos++ = zigzag;
+
+  s->len = pos - (s->block + SERIES_HDR_LEN);
+  s->count++;
+  s->last = value;
+  s->last_time = now;
+
+  return 0;
+}
+
+
+uint16_t series_encode(struct series *s, unsigned long now){
+  unsigned long age = (s->count > 0)?now - s->last_time:0;
+
+  put_u16(s->block + 3, s->count);
+  put_u16(s->block + 5, (age > 0xffff)?0xffff:age);
+
+  return SERIES_HDR_LEN + s->len;
+}
+
+
+int series_open(struct series_reader *r, const uint8_t *block, uint16_t len){
+  if (len < SERIES_HDR_LEN)
+    return -1;
+
+  r->reading = block[0];
+  r->period = get_u16(block + 1);
+  r->count = get_u16(block + 3);
+  r->age = get_u16(block + 5);
+  r->pos = block + SERIES_HDR_LEN;
+  r->end = block + len;
+  r->index = 0;
+  r->value = 0;
+
+  return 0;
+}
+
+
+int series_next(struct series_reader *r, int16_t *value, unsigned long *age){
+  unsigned long zigzag = 0;
+  uint8_t shift = 0;
+
+  if (r->index == r->count)
+    return 0;
+
+  do{
+    if (r->pos == r->end || shift >= 7*VARINT_MAX_LEN)
+      return -1;
+
+    zigzag |= (unsigned long)(*r->pos & 0x7f) << shift;
+    shift += 7;
+  }while (*r->pos++ & 0x80);
+
+  if (zigzag & 1)
+    r->value -= (int16_t)((zigzag + 1) >> 1);
+  else
+    r->value += (int16_t)(zigzag >> 1);
+
+  //the samples are period seconds apart, the last one is age seconds old
+  *value = r->value;
+  *age = r->age + (unsigned long)(r->count - 1 - r->index) * r->period;
+  r->index++;
+
+  return 1;
+}
+
+
+int series_check(const uint8_t *block, uint16_t len){
+  struct series_reader r;
+  unsigned long age;
+  int16_t value;
+  int ret;
+
+  if (series_open(&r, block, len) < 0)
+    return -1;
+
+  while ((ret = series_next(&r, &value, &age)) > 0)
+    ;
+
+  return (ret == 0 && r.pos == r.end)?0:-1;
+}
@@ -0,0 +1,89 @@
+#ifndef SERIES_H_
+#define SERIES_H_
+
+#include "contiki.h"
+
+/*******************************************************************************
+  Time series of a reading, compressed, without any access to sensors or radio.
+
+  Node1 and Node2 sample every few seconds but a reading on the air costs a
+  frame. The samples are instead appended to a series: each one is stored as
+  the difference with the one before (the first one with 0), zigzag encoded
+  (0, -1, 1, -2, ... become 0, 1, 2, 3, ...) and written as a varint, 7 bits
+  per byte with the high bit set when another byte follows. A temperature or
+  a light that changes slowly takes a byte per sample instead of a frame.
+
+  The series travels as a single block (see bulk.h): a header followed by the
+  encoded samples, oldest first
+
+    byte 0      reading (MSG_TLV_TEMPERATURE/LIGHT)
+    byte 1-2    period of the samples in seconds (uint16)
+    byte 3-4    number of samples (uint16)
+    byte 5-6    age of the last sample in seconds (uint16)
+    byte 7..    samples
+
+  The samples are taken every period seconds, so their times are not sent.
+*******************************************************************************/
+
+#define SERIES_HDR_LEN 7
+
+//bytes of encoded samples (see project-conf.h)
+#ifndef SERIES_SIZE
+#define SERIES_SIZE 180
+#endif
+
+struct series {
+  uint8_t block[SERIES_HDR_LEN + SERIES_SIZE];
+  uint16_t len;           //bytes of samples
+  uint16_t count;
+  int16_t last;
+  unsigned long last_time;    //clock_seconds() of the last sample
+};
+
+struct series_reader {
+  uint8_t reading;
+  uint16_t period;
+  uint16_t count;
+  uint16_t age;
+  const uint8_t *pos;
+  const uint8_t *end;
+  uint16_t index;
+  int16_t value;
+};
+
+void series_init(struct series *s, uint8_t reading, uint16_t period);
+
+/*
+  append a sample taken at now (clock_seconds()). Return 0, -1 if the series
+  is full: the sample is not appended
+*/
+int series_add(struct series *s, int16_t value, unsigned long now);
+
+/*
+  complete the header of the block at now and return its length. The block
+  is s->block
+*/
+uint16_t series_encode(struct series *s, unsigned long now);
+
+//empty the series, after the block has been sent
+void series_reset(struct series *s);
+
+/*
+  read a block. Return 0, -1 if it is shorter than its header
+*/
+int series_open(struct series_reader *r, const uint8_t *block, uint16_t len);
+
+/*
+  validate a received block before reading it: return 0 if its samples, as
+  many as its header says, end exactly at the end of the block, -1 otherwise
+  (truncated, too long, or a header that does not match the samples)
+*/
+int series_check(const uint8_t *block, uint16_t len);
+
+/*
+  next sample of the block, oldest first, and its age in seconds. Return 1 if
+  a sample is available, 0 at the end, -1 if the block is truncated
+*/
+int series_next(struct series_reader *r, int16_t *value, unsigned long *age);
+
+#endif /* SERIES_H_ */
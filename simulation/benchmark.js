@@ -0,0 +1,215 @@
+/*
+ * Cooja benchmark of the four firmware images (see home.csc).
+ *
+ * The script presses the button of the Central Unit (mote 3) to issue the
+ * commands 1-6 of the menu and measures, from the serial output of the motes:
+ *   - the latency of each command, from "Command = N." on the CU to the
+ *     moment the command has been executed by its destination (or, for the
+ *     readings 4 and 5, answered from the cache of the CU)
+ *   - the replies lost (runicast timeouts and commands never completed)
+ *   - the runicast retransmissions
+ *   - the group commands (1 and 3) not acknowledged by every regular node
+ *   - the radio on time (tx + listen) of each node, from the Energest reports
+ *     collected by the CU (stats.c)
+ * Every result line starts with "BENCH" in COOJA.testlog.
+ */
+
+TIMEOUT(1200000, summary(); log.testFailed());
+
+var CU = 3;
+//ms of simulated time between two presses of the same command
+var PRESS_GAP = 300;
+//the CU waits 4 s after the last press to read the command
+var COMMAND_WINDOW = 4000;
+//a command not completed within this time is lost
+var COMMAND_TIMEOUT = 20000;
+
+/*
+ * alarm off, gate unlocked, sensor readings, extension on, guest entry,
+ * back to the initial state, alarm on and off
+ */
+var sequence = [2, 4, 5, 6, 3, 4, 5, 2, 6, 1, 1];
+
+var latencies = {};
+var lost = 0;
+var rejected = 0;
+var timeouts = 0;
+var retransmissions = 0;
+var groups = 0;
+var groupsIncomplete = 0;
+var radio = {};
+var tag = 0;
+
+var statsRegex = /^Stats (\d+)\.(\d+): period (\d+) ms, cpu (\d+) ms, lpm (\d+) ms, tx (\d+) ms, listen (\d+) ms/;
+
+/*
+ * bookkeeping done on every line printed by any mote
+ */
+function account(id, line) {
+  var m;
+
+  if (line.indexOf("runicast message timed out") == 0) {
+    timeouts++;
+  }
+
+  m = line.match(/^runicast message sent to .*retransmissions (\d+)/);
+  if (m != null) {
+    retransmissions += parseInt(m[1]);
+  }
+
+  if (id == CU) {
+    m = line.match(/^Group command \d+: \d+ members, .*missing 0x([0-9a-f]+)/);
+    if (m != null) {
+      groups++;
+      if (parseInt(m[1], 16) != 0) {
+        groupsIncomplete++;
+      }
+    }
+
+    m = line.match(statsRegex);
+    if (m != null) {
+      var node = m[1] + "." + m[2];
+      if (radio[node] == undefined) {
+        radio[node] = {period: 0, cpu: 0, tx: 0, listen: 0};
+      }
+      radio[node].period += parseInt(m[3]);
+      radio[node].cpu += parseInt(m[4]);
+      radio[node].tx += parseInt(m[6]);
+      radio[node].listen += parseInt(m[7]);
+    }
+  }
+}
+
+/*
+ * wait for the next line satisfying done(id, line), or for timeout ms of
+ * simulated time. Return the time of the line, -1 on timeout
+ */
+function waitFor(done, timeout) {
+  var timer = "timeout-" + (tag++);
+
+  GENERATE_MSG(timeout, timer);
+  while (true) {
+    YIELD();
+    if (msg.equals(timer)) {
+      return -1;
+    }
+    account(id, "" + msg);
+    if (done(id, "" + msg)) {
+      return time;
+    }
+  }
+}
+
+function sleep(ms) {
+  var timer = "sleep-" + (tag++);
+
+  GENERATE_MSG(ms, timer);
+  while (true) {
+    YIELD();
+    if (msg.equals(timer)) {
+      return;
+    }
+    account(id, "" + msg);
+  }
+}
+
+function completes(command) {
+  return function(id, line) {
+    switch (command) {
+      case 1:
+      case 3:
+        return (id == 1 || id == 2) &&
+               line.indexOf("broadcast message received from 3.0") == 0;
+      case 2:
+        return id == CU && line.indexOf("runicast message sent to 2.0") == 0;
+      case 4:
+        return id == CU &&
+               /^(Received|Pushed|Cached) temperature/.test(line);
+      case 5:
+        return id == CU && /^(Received|Pushed|Cached) light/.test(line);
+      case 6:
+        return id == 4 &&
+               line.indexOf("broadcast message received from 3.0") == 0;
+    }
+    return false;
+  };
+}
+
+function issue(command) {
+  var button = sim.getMoteWithID(CU).getInterfaces().getButton();
+  var start, end, i;
+
+  for (i = 0; i < command; i++) {
+    button.clickButton();
+    sleep(PRESS_GAP);
+  }
+
+  start = waitFor(function(id, line) {
+    return id == CU && (line.indexOf("Command = " + command + ".") == 0 ||
+                        line.indexOf("Command rejected") == 0);
+  }, COMMAND_WINDOW + COMMAND_TIMEOUT);
+  if (start < 0 || msg.indexOf("Command rejected") == 0) {
+    log.log("BENCH command " + command + " rejected\n");
+    rejected++;
+    return;
+  }
+
+  end = waitFor(completes(command), COMMAND_TIMEOUT);
+  if (end < 0) {
+    log.log("BENCH command " + command + " lost\n");
+    lost++;
+    return;
+  }
+
+  //simulated time is in microseconds
+  var latency = (end - start) / 1000;
+  log.log("BENCH command " + command + " latency " + latency + " ms\n");
+  if (latencies[command] == undefined) {
+    latencies[command] = [];
+  }
+  latencies[command].push(latency);
+
+  //let the nodes go back to sleep before the next command
+  sleep(COMMAND_WINDOW);
+}
+
+function summary() {
+  var command, node, i;
+
+  for (command in latencies) {
+    var l = latencies[command];
+    var sum = 0, max = 0;
+    for (i = 0; i < l.length; i++) {
+      sum += l[i];
+      max = Math.max(max, l[i]);
+    }
+    log.log("BENCH summary command " + command + ": " + l.length +
+            " delivered, mean " + (sum / l.length).toFixed(1) +
+            " ms, max " + max.toFixed(1) + " ms\n");
+  }
+  log.log("BENCH summary lost commands " + lost + ", rejected " + rejected +
+          ", runicast timeouts " + timeouts +
+          ", retransmissions " + retransmissions + "\n");
+  log.log("BENCH summary group commands " + groups + ", not acknowledged by " +
+          "every node " + groupsIncomplete + "\n");
+
+  for (node in radio) {
+    var r = radio[node];
+    log.log("BENCH summary node " + node + ": radio on " + (r.tx + r.listen) +
+            " ms over " + r.period + " ms (tx " + r.tx + " ms, listen " +
+            r.listen + " ms), cpu " + r.cpu + " ms\n");
+  }
+}
+
+//let every mote boot, open its connections and discover the others
+sleep(20000);
+
+for (var c = 0; c < sequence.length; c++) {
+  issue(sequence[c]);
+}
+
+//wait for the energy reports covering the whole run (STATS_PERIOD is 60 s)
+sleep(65000);
+
+summary();
+log.testOK();
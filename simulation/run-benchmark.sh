@@ -0,0 +1,30 @@
+#!/bin/sh
+#
+# Build the four firmware images and run the Cooja benchmark (home.csc,
+# benchmark.js) without GUI. The results are the BENCH lines of
+# simulation/COOJA.testlog.
+#
+# usage: simulation/run-benchmark.sh [path to contiki]
+#
+# Cooja has to be built first (cd $CONTIKI/tools/cooja && ant jar). Extra make
+# variables (e.g. RADIO_PROFILE=alwayson) are taken from MAKEFLAGS. The
+# network key is the public test key of noncoresec unless LLSEC_KEY is set:
+# the same one is in the build commands of home.csc.
+
+set -e
+
+CONTIKI=${1:-${CONTIKI:-/home/user/contiki}}
+DIR=$(cd "$(dirname "$0")" && pwd)
+LLSEC_KEY=${LLSEC_KEY:-0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0a,0x0b,0x0c,0x0d,0x0e,0x0f}
+
+make -C "$DIR/.." TARGET=sky CONTIKI="$CONTIKI" LLSEC_KEY="$LLSEC_KEY" \
+  CentralUnit.sky Node1.sky Node2.sky extension_node.sky
+
+cd "$DIR"
+rm -f COOJA.testlog
+status=0
+java -mx512m -jar "$CONTIKI/tools/cooja/dist/cooja.jar" \
+  -nogui="$DIR/home.csc" -contiki="$CONTIKI" || status=$?
+
+grep '^BENCH' COOJA.testlog
+exit $status
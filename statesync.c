@@ -0,0 +1,149 @@
+#include "contiki.h"
+#include "net/rime/rime.h"
+#include "lib/trickle-timer.h"
+#include "stdio.h"
+#include <string.h>
+#include "statesync.h"
+
+//result of the comparison of a vector heard with the local one
+enum {
+  STATESYNC_OLDER,
+  STATESYNC_SAME,
+  STATESYNC_NEWER
+};
+
+static struct home_state *state;
+static uint16_t version;
+static statesync_callback_t changed_callback;
+
+static struct trickle_timer trickle;
+static struct broadcast_conn statesync_conn;
+
+
+void statesync_encode(uint8_t *buf){
+  msg_put_u16(buf, version);
+  buf[2] = state->alarm_state;
+  buf[3] = state->gate_locked;
+  buf[4] = state->extension_active;
+}
+
+
+uint16_t statesync_version(void){
+  return version;
+}
+
+
+static void print_state(void){
+  printf("State version %u: alarm %d, gate locked %d, extension %d\n", version,
+          state->alarm_state, state->gate_locked, state->extension_active);
+}
+
+
+static int compare(const uint8_t *buf){
+  uint8_t local[STATESYNC_LEN];
+  //the version wraps around: newer means ahead by less than half the range
+  int16_t diff = (int16_t)(msg_get_u16(buf) - version);
+  int cmp;
+
+  if (diff > 0)
+    return STATESYNC_NEWER;
+  if (diff < 0)
+    return STATESYNC_OLDER;
+
+  /*
+    two writers have produced the same version (the CU and node 1.0 at the
+    same time): the greatest vector wins, so every node picks the same one
+  */
+  statesync_encode(local);
+  cmp = memcmp(buf + 2, local + 2, STATESYNC_LEN - 2);
+
+  if (cmp > 0)
+    return STATESYNC_NEWER;
+
+  return (cmp < 0)?STATESYNC_OLDER:STATESYNC_SAME;
+}
+
+
+/*******************************************************************************
+  merge a vector heard with the local one and feed Trickle: a vector in line
+  with ours is a consistent transmission, anything else an inconsistency
+*******************************************************************************/
+int statesync_recv(const struct msg_tlv *tlv){
+  if (tlv->len < STATESYNC_LEN)
+    return 0;
+
+  switch (compare(tlv->value)){
+    case STATESYNC_SAME:
+      trickle_timer_consistency(&trickle);
+      return 0;
+    case STATESYNC_OLDER:
+      //the neighbour missed a change: send ours soon
+      trickle_timer_inconsistency(&trickle);
+      return 0;
+  }
+
+  version = msg_get_u16(tlv->value);
+  state->alarm_state = tlv->value[2];
+  state->gate_locked = tlv->value[3];
+  state->extension_active = tlv->value[4];
+  print_state();
+
+  //spread it quickly to the neighbours that do not have it yet
+  trickle_timer_inconsistency(&trickle);
+
+  return 1;
+}
+
+
+static void recv_bc(struct broadcast_conn *c, const linkaddr_t *from){
+  struct msg_reader reader;
+  struct msg_tlv tlv;
+
+  if (msg_open(&reader) < 0 || reader.opcode != MSG_OP_STATE)
+    return;
+
+  while (msg_next(&reader, &tlv) > 0)
+    if (tlv.type == MSG_TLV_STATE && statesync_recv(&tlv) &&
+                                                  changed_callback != NULL)
+      changed_callback();
+}
+
+static const struct broadcast_callbacks broadcast_calls = {recv_bc, NULL};
+
+
+/*******************************************************************************
+  called by Trickle once per interval: the vector is sent unless enough
+  neighbours have already sent the same one
+*******************************************************************************/
+static void transmit(void *ptr, uint8_t suppress){
+  uint8_t buf[STATESYNC_LEN];
+
+  if (suppress == TRICKLE_TIMER_TX_SUPPRESS)
+    return;
+
+  msg_begin(MSG_OP_STATE, 0);
+  statesync_encode(buf);
+  msg_append(MSG_TLV_STATE, buf, sizeof(buf));
+  broadcast_send(&statesync_conn);
+}
+
+
+void statesync_open(struct home_state *s, statesync_callback_t changed){
+  state = s;
+  version = 0;
+  changed_callback = changed;
+
+  broadcast_open(&statesync_conn, STATESYNC_CHANNEL, &broadcast_calls);
+
+  trickle_timer_config(&trickle, STATESYNC_IMIN, STATESYNC_IMAX,
+                                                      STATESYNC_REDUNDANCY);
+  trickle_timer_set(&trickle, transmit, NULL);
+}
+
+
+void statesync_changed(void){
+  version++;
+  print_state();
+
+  trickle_timer_inconsistency(&trickle);
+}
@@ -0,0 +1,75 @@
+#ifndef STATESYNC_H_
+#define STATESYNC_H_
+
+#include "contiki.h"
+#include "message.h"
+#include "home.h"
+
+/*******************************************************************************
+  Replicated state of the house.
+
+  The alarm, the gate and the extension (struct home_state) are a single state
+  vector with a version number, shared by the CU and every node. Whoever
+  changes the vector (the CU after a command, node 1.0 when it refuses the
+  alarm) increments the version; a node adopts a vector only if its version
+  is newer than the one it has, so a command received twice or late is never
+  applied twice.
+
+  The vector is disseminated with Trickle (RFC 6206) on STATESYNC_CHANNEL:
+  every node broadcasts it at a random time of its interval, unless it has
+  already heard STATESYNC_REDUNDANCY copies of the same version. A newer or an
+  older version heard resets the interval to STATESYNC_IMIN, so a change (or a
+  node that missed it) spreads in a few seconds; once the network agrees the
+  interval doubles up to STATESYNC_IMIN << STATESYNC_IMAX and the traffic
+  fades away. A node that has missed a command, or has just rebooted, catches
+  up at the next exchange: no acknowledgement is needed.
+
+  The same vector travels in the STATE entry of the command frames of the CU,
+  so that the nodes in range react at once (statesync_recv).
+*******************************************************************************/
+
+#define STATESYNC_CHANNEL 138
+
+//size of the STATE entry: version (uint16), alarm, gate, extension
+#define STATESYNC_LEN 5
+
+#ifndef STATESYNC_IMIN
+#define STATESYNC_IMIN CLOCK_SECOND
+#endif
+//doublings of the interval: 128 seconds at most
+#ifndef STATESYNC_IMAX
+#define STATESYNC_IMAX 7
+#endif
+#ifndef STATESYNC_REDUNDANCY
+#define STATESYNC_REDUNDANCY 1
+#endif
+
+/*
+  called when a newer vector heard from a neighbour has been copied in the
+  state: the node compares it with what its actuators are doing
+*/
+typedef void (*statesync_callback_t)(void);
+
+/*
+  start the dissemination of state, version 0 (the default state of
+  home_init). state is updated in place when a newer vector is adopted
+*/
+void statesync_open(struct home_state *state, statesync_callback_t changed);
+
+/*
+  the state has been changed locally: increment the version and spread it
+*/
+void statesync_changed(void);
+
+/*
+  STATE entry of a frame. Return 1 if the vector has been adopted (the
+  callback is not called: the caller applies it), 0 otherwise
+*/
+int statesync_recv(const struct msg_tlv *tlv);
+
+//write the vector in buf (STATESYNC_LEN bytes), as in the STATE entry
+void statesync_encode(uint8_t *buf);
+
+uint16_t statesync_version(void);
+
+#endif /* STATESYNC_H_ */
@@ -0,0 +1,247 @@
+#include "contiki.h"
+#include "net/rime/rime.h"
+#include "sys/energest.h"
+#include "stdio.h"
+#include "message.h"
+#include "stats.h"
+#include "transport.h"
+#if TRANSPORT_CONF_MULTIHOP
+#include "net/rime/collect-link-estimate.h"
+#endif
+
+static const char *app_names[STATS_APP_NUM] = {
+  "command", "temperature", "light", "actuators", "sensing", "monitoring"
+};
+
+//Energest values of the last report
+static const uint8_t energest_types[] = {
+  ENERGEST_TYPE_CPU, ENERGEST_TYPE_LPM, ENERGEST_TYPE_TRANSMIT,
+  ENERGEST_TYPE_LISTEN
+};
+#define ENERGEST_NUM (sizeof(energest_types)/sizeof(energest_types[0]))
+static unsigned long last_energest[ENERGEST_NUM];
+
+//rtimer ticks spent by each application
+static unsigned long app_ticks[STATS_APP_NUM];
+static unsigned long app_last[STATS_APP_NUM];
+static rtimer_clock_t app_start[STATS_APP_NUM];
+
+//send queue reported with the energy (NULL if none)
+static struct sendqueue *queue;
+
+static linkaddr_t receiver;
+static int send_reports = 0;
+
+PROCESS(stats_process, "Stats process");
+
+
+/*******************************************************************************
+  convert rtimer ticks in ms (saturated to 16 bits) without overflowing
+*******************************************************************************/
+static uint16_t ticks_to_ms(unsigned long ticks){
+  unsigned long ms = (ticks / RTIMER_SECOND) * 1000 +
+                                    (ticks % RTIMER_SECOND) * 1000 / RTIMER_SECOND;
+
+  return (ms > 0xffff)?0xffff:(uint16_t)ms;
+}
+
+
+#if TRANSPORT_CONF_MULTIHOP
+/*******************************************************************************
+  print a collect metric as an ETX with one decimal
+*******************************************************************************/
+static void print_etx(const char *name, uint16_t metric){
+  unsigned long tenths = (unsigned long)metric * 10 / COLLECT_LINK_ESTIMATE_UNIT;
+
+  printf(", %s %lu.%lu", name, tenths / 10, tenths % 10);
+}
+#endif
+
+
+void stats_print_report(const linkaddr_t *from){
+  struct msg_reader reader;
+  struct msg_tlv tlv;
+  uint16_t period, cpu, lpm, tx, listen;
+
+  if (msg_open(&reader) < 0 || reader.opcode != MSG_OP_STATS){
+    printf("Error: malformed stats report\n");
+    return;
+  }
+
+  while (msg_next(&reader, &tlv) > 0){
+    switch (tlv.type){
+      case MSG_TLV_ENERGEST:
+        if (tlv.len < 10)
+          break;
+
+        period = msg_get_u16(tlv.value);
+        cpu = msg_get_u16(tlv.value + 2);
+        lpm = msg_get_u16(tlv.value + 4);
+        tx = msg_get_u16(tlv.value + 6);
+        listen = msg_get_u16(tlv.value + 8);
+
+        printf("Stats %d.%d: period %u ms, cpu %u ms, lpm %u ms, tx %u ms, listen %u ms",
+            from->u8[0], from->u8[1], period, cpu, lpm, tx, listen);
+        //radio duty cycle in per mille
+        if (period > 0)
+          printf(", radio on %lu/1000",
+                    ((unsigned long)tx + listen) * 1000 / period);
+        printf("\n");
+
+        break;
+      case MSG_TLV_APP_TIME:
+        if (tlv.len < 3 || tlv.value[0] >= STATS_APP_NUM)
+          break;
+
+        printf("Stats %d.%d: %s %u ms\n", from->u8[0], from->u8[1],
+                      app_names[tlv.value[0]], msg_get_u16(tlv.value + 1));
+
+        break;
+      case MSG_TLV_QUEUE:
+        if (tlv.len < MSG_TLV_QUEUE_LEN)
+          break;
+
+        printf("Stats %d.%d: queue depth %u, max %u, queued %u, dropped %u\n",
+            from->u8[0], from->u8[1], tlv.value[0], tlv.value[1],
+            msg_get_u16(tlv.value + 2), msg_get_u16(tlv.value + 4));
+
+        break;
+#if TRANSPORT_CONF_MULTIHOP
+      case MSG_TLV_ROUTE:
+        if (tlv.len < 6)
+          break;
+
+        printf("Stats %d.%d: parent %d.%d", from->u8[0], from->u8[1],
+                                              tlv.value[0], tlv.value[1]);
+        print_etx("path etx", msg_get_u16(tlv.value + 2));
+        print_etx("link etx", msg_get_u16(tlv.value + 4));
+        printf("\n");
+
+        break;
+#endif
+    }
+  }
+}
+
+
+static void recv_uc(struct unicast_conn *c, const linkaddr_t *from){
+  stats_print_report(from);
+}
+
+static const struct unicast_callbacks unicast_calls = {recv_uc, NULL};
+static struct unicast_conn stats_conn;
+
+
+/*******************************************************************************
+  build the report of the last period in the packetbuf: Energest deltas, the
+  active time of every application that did something and the send queue
+*******************************************************************************/
+static void build_report(clock_time_t period){
+  uint8_t buf[10];
+  unsigned long now;
+  uint8_t i;
+
+  energest_flush();
+
+  msg_begin(MSG_OP_STATS, 0);
+
+  msg_put_u16(buf, (uint16_t)((unsigned long)period * 1000 / CLOCK_SECOND));
+  for (i = 0; i < ENERGEST_NUM; i++){
+    now = energest_type_time(energest_types[i]);
+    msg_put_u16(buf + 2 + 2*i, ticks_to_ms(now - last_energest[i]));
+    last_energest[i] = now;
+  }
+  msg_append(MSG_TLV_ENERGEST, buf, sizeof(buf));
+
+  for (i = 0; i < STATS_APP_NUM; i++){
+    if (app_ticks[i] == app_last[i])
+      continue;
+
+    buf[0] = i;
+    msg_put_u16(buf + 1, ticks_to_ms(app_ticks[i] - app_last[i]));
+    msg_append(MSG_TLV_APP_TIME, buf, 3);
+    app_last[i] = app_ticks[i];
+  }
+
+  if (queue != NULL){
+    buf[0] = sendqueue_depth(queue);
+    buf[1] = queue->max_depth;
+    msg_put_u16(buf + 2, queue->queued);
+    msg_put_u16(buf + 4, queue->dropped);
+    msg_append(MSG_TLV_QUEUE, buf, MSG_TLV_QUEUE_LEN);
+  }
+
+#if TRANSPORT_CONF_MULTIHOP
+  if (send_reports)
+    transport_append_route();
+#endif
+}
+
+
+PROCESS_THREAD(stats_process, ev, data){
+  static struct etimer stats_timer;
+  uint8_t i;
+
+  PROCESS_EXITHANDLER(unicast_close(&stats_conn));
+
+  PROCESS_BEGIN();
+
+  unicast_open(&stats_conn, STATS_CHANNEL, &unicast_calls);
+
+  energest_flush();
+  for (i = 0; i < ENERGEST_NUM; i++)
+    last_energest[i] = energest_type_time(energest_types[i]);
+
+  etimer_set(&stats_timer, STATS_PERIOD);
+
+  while(1){
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&stats_timer));
+    etimer_reset(&stats_timer);
+
+    build_report(STATS_PERIOD);
+
+    if (!send_reports)
+      stats_print_report(&linkaddr_node_addr);
+#if TRANSPORT_CONF_MULTIHOP
+    else
+      //along the collect tree, the CU may be several hops away
+      transport_send_to_cu(NULL);
+#else
+    //nothing is sent until the CU has been discovered
+    else if (!linkaddr_cmp(&receiver, &linkaddr_null))
+      unicast_send(&stats_conn, &receiver);
+#endif
+  }
+
+  PROCESS_END();
+}
+
+
+void stats_start(const linkaddr_t *to){
+  if (to != NULL){
+    linkaddr_copy(&receiver, to);
+    send_reports = 1;
+  }
+
+  process_start(&stats_process, NULL);
+}
+
+
+void stats_watch_queue(struct sendqueue *sq){
+  queue = sq;
+}
+
+
+void stats_set_receiver(const linkaddr_t *to){
+  linkaddr_copy(&receiver, to);
+}
+
+
+void stats_app_begin(uint8_t app){
+  app_start[app] = RTIMER_NOW();
+}
+
+
+void stats_app_end(uint8_t app){
+  app_ticks[app] += (rtimer_clock_t)(RTIMER_NOW() - app_start[app]);
+}
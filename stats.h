@@ -0,0 +1,63 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+#include "sendqueue.h"
+
+/*******************************************************************************
+  Energy and CPU accounting.
+
+  The stats process samples Energest (cpu, lpm, tx, listen) every STATS_PERIOD
+  and sends the deltas since the last sample to the CU over STATS_CHANNEL.
+  The send queue of the replies to the CU, if any, is reported too.
+  Energest does not know about processes, so the applications mark their active
+  sections with stats_app_begin/stats_app_end and the time spent inside them is
+  reported per application.
+*******************************************************************************/
+
+#ifndef STATS_PERIOD
+#define STATS_PERIOD (CLOCK_SECOND*60)
+#endif
+
+//rime channel of the reports
+#define STATS_CHANNEL 132
+
+//applications accounted (shared by every node so that the CU can name them)
+enum {
+  STATS_APP_COMMAND,      //CU: handle_command_process
+  STATS_APP_TEMPERATURE,  //Node1: temperature_process, compute_mean_temperateure
+  STATS_APP_LIGHT,        //Node2: sensing_light
+  STATS_APP_ACTUATORS,    //Node1/Node2: blinking, door and gate processes
+  STATS_APP_SENSING,      //extension node: sensing_process
+  STATS_APP_MONITORING,   //extension node: temperature_monitoring_process
+  STATS_APP_NUM
+};
+
+/*
+  start the stats process. The reports are sent to receiver, or printed on the
+  serial line if receiver is NULL (the CU itself). Every node opens the stats
+  channel, the CU prints the reports it receives
+*/
+void stats_start(const linkaddr_t *receiver);
+
+/*
+  change the receiver of the reports. A node starts with linkaddr_null, the
+  reports are not sent until the CU has been discovered
+*/
+void stats_set_receiver(const linkaddr_t *receiver);
+
+//report the counters of the send queue of the replies to the CU
+void stats_watch_queue(struct sendqueue *sq);
+
+/*
+  print the report in the packetbuf, sent by from. Used by the CU for the
+  reports coming from the multi-hop transport
+*/
+void stats_print_report(const linkaddr_t *from);
+
+//mark the beginning and the end of an active section of an application
+void stats_app_begin(uint8_t app);
+void stats_app_end(uint8_t app);
+
+#endif /* STATS_H_ */
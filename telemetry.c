@@ -0,0 +1,57 @@
+#include "contiki.h"
+#include "telemetry.h"
+
+
+void telemetry_init(struct telemetry *t){
+  t->active = 0;
+  t->reported = 0;
+  t->delta = 0;
+  t->max_interval = 0;
+  t->last_value = 0;
+  t->last_time = 0;
+}
+
+
+void telemetry_subscribe(struct telemetry *t, int16_t delta,
+                                                    uint16_t max_interval){
+  t->active = 1;
+  //a new subscription starts with a push
+  t->reported = 0;
+  t->delta = delta;
+  t->max_interval = max_interval;
+}
+
+
+void telemetry_unsubscribe(struct telemetry *t){
+  t->active = 0;
+}
+
+
+int telemetry_due(const struct telemetry *t, int16_t value){
+  int16_t change;
+
+  if (!t->active)
+    return 0;
+
+  if (!t->reported)
+    return 1;
+
+  change = (value > t->last_value)? value - t->last_value :
+                                                    t->last_value - value;
+  if (change >= t->delta)
+    return 1;
+
+  //no change, but the CU has to know that the reading is still valid
+  if (t->max_interval > 0 &&
+                    clock_seconds() - t->last_time >= t->max_interval)
+    return 1;
+
+  return 0;
+}
+
+
+void telemetry_reported(struct telemetry *t, int16_t value){
+  t->reported = 1;
+  t->last_value = value;
+  t->last_time = clock_seconds();
+}
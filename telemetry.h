@@ -0,0 +1,40 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdint.h>
+
+/*******************************************************************************
+  Push telemetry of a node, without any access to sensors or radio.
+
+  After a subscription of the CU the node pushes a reading only when it differs
+  by at least delta from the last one pushed, or when max_interval seconds have
+  elapsed since then (so that the CU knows that the node is alive and the
+  reading is still valid). The first sample after the subscription is always
+  pushed.
+
+  The subscription is soft state: a node that reboots forgets it, and the CU
+  subscribes again when the pushes stop.
+*******************************************************************************/
+
+struct telemetry {
+  uint8_t active;
+  uint8_t reported;           //a reading has been pushed since the subscription
+  int16_t delta;
+  uint16_t max_interval;      //seconds
+  int16_t last_value;
+  unsigned long last_time;    //clock_seconds() of the last push
+};
+
+void telemetry_init(struct telemetry *t);
+
+void telemetry_subscribe(struct telemetry *t, int16_t delta,
+                                                    uint16_t max_interval);
+void telemetry_unsubscribe(struct telemetry *t);
+
+//return 1 if value has to be pushed to the CU
+int telemetry_due(const struct telemetry *t, int16_t value);
+
+//value has been pushed
+void telemetry_reported(struct telemetry *t, int16_t value);
+
+#endif /* TELEMETRY_H_ */
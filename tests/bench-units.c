@@ -0,0 +1,217 @@
+/*******************************************************************************
+  Micro-benchmarks of the hardware-independent units, run on the host
+  (make bench).
+
+  The host is not a MSP430: the absolute times only tell the cost of a call
+  relative to another one, e.g. the O(1) statistics of the window against a
+  scan of the samples, or the fixed point dB against log10f. Every benchmark
+  prints the mean time of a call in ns.
+*******************************************************************************/
+#include "contiki.h"
+#include "stdio.h"
+#include "math.h"
+#include "time.h"
+#include "message.h"
+#include "home.h"
+#include "presence.h"
+#include "window.h"
+#include "decibel.h"
+#include "burst.h"
+#include "series.h"
+#include "dedup.h"
+
+#define RUNS 1000000L
+
+//the results are written here, so the compiler keeps the calls
+static volatile long sink;
+
+static struct timespec started;
+
+
+static void bench_begin(void){
+  clock_gettime(CLOCK_MONOTONIC, &started);
+}
+
+
+static void bench_end(const char *name, long calls){
+  struct timespec now;
+  double ns;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  ns = (now.tv_sec - started.tv_sec) * 1e9 + (now.tv_nsec - started.tv_nsec);
+
+  printf("%-36s %10.1f ns\n", name, ns / calls);
+}
+
+
+/*******************************************************************************
+  window.c: add a sample and read every statistic, as Node1 does at every
+  temperature sample, against a scan of the same samples
+*******************************************************************************/
+#define BENCH_WINDOW_SIZE 360
+WINDOW(sample_window, BENCH_WINDOW_SIZE);
+
+static void bench_window(void){
+  long i, sum;
+  int16_t min;
+  uint16_t j;
+
+  window_init(&sample_window);
+
+  bench_begin();
+  for (i = 0; i < RUNS; i++){
+    window_add(&sample_window, (int16_t)(i % 97) - 48);
+    sink = window_mean(&sample_window) + window_min(&sample_window) +
+              window_max(&sample_window) + window_variance(&sample_window);
+  }
+  bench_end("window add + statistics", RUNS);
+
+  bench_begin();
+  for (i = 0; i < RUNS / 100; i++){
+    sum = 0;
+    min = sample_window_samples[0];
+    for (j = 0; j < BENCH_WINDOW_SIZE; j++){
+      sum += sample_window_samples[j];
+      if (sample_window_samples[j] < min)
+        min = sample_window_samples[j];
+    }
+    sink = sum / BENCH_WINDOW_SIZE + min;
+  }
+  bench_end("window scan (reference)", RUNS / 100);
+}
+
+
+/*******************************************************************************
+  decibel.c against the floating point conversion
+*******************************************************************************/
+static void bench_decibel(void){
+  long i;
+
+  bench_begin();
+  for (i = 0; i < RUNS; i++)
+    sink = decibel_from_mv(decibel_adc_to_mv(i & 4095));
+  bench_end("decibel fixed point", RUNS);
+
+  bench_begin();
+  for (i = 0; i < RUNS; i++)
+    sink = (int)(20 * log10f((float)((i & 4095) * 3300 / 4096 * 5000 / 3000)
+                                                                      + 1));
+  bench_end("decibel log10f (reference)", RUNS);
+}
+
+
+/*******************************************************************************
+  burst.c: a whole burst, sampled and analysed
+*******************************************************************************/
+static void bench_burst(void){
+  static struct burst b;
+  struct burst_level level;
+  long i;
+  int j;
+
+  bench_begin();
+  for (i = 0; i < RUNS / BURST_SAMPLES; i++){
+    burst_init(&b);
+    for (j = 0; j < BURST_SAMPLES; j++)
+      burst_add(&b, (uint16_t)((i + j * 37) & 4095));
+    burst_analyse(&b, &level);
+    sink = level.rms + level.peak;
+  }
+  bench_end("burst of BURST_SAMPLES", RUNS / BURST_SAMPLES);
+}
+
+
+/*******************************************************************************
+  series.c: a full series encoded and decoded
+*******************************************************************************/
+static void bench_series(void){
+  static struct series s;
+  struct series_reader r;
+  int16_t value;
+  unsigned long age;
+  uint16_t len;
+  long i, samples = 0;
+
+  series_init(&s, MSG_TLV_TEMPERATURE, 10);
+
+  bench_begin();
+  for (i = 0; i < RUNS / 100; i++){
+    series_reset(&s);
+    while (series_add(&s, 240 + (int16_t)((i + s.count) % 7) - 3,
+                                                          s.count * 10) == 0)
+      samples++;
+    sink = series_encode(&s, s.count * 10);
+  }
+  bench_end("series add (per sample)", samples);
+
+  len = series_encode(&s, s.count * 10);
+  samples = 0;
+  bench_begin();
+  for (i = 0; i < RUNS / 100; i++){
+    series_open(&r, s.block, len);
+    while (series_next(&r, &value, &age) > 0)
+      samples++;
+    sink = value;
+  }
+  bench_end("series next (per sample)", samples);
+}
+
+
+/*******************************************************************************
+  dedup.c: in-order frames of two senders
+*******************************************************************************/
+static void bench_dedup(void){
+  static struct dedup d;
+  linkaddr_t a = {{1, 0}}, b = {{2, 0}};
+  long i;
+
+  dedup_init(&d);
+
+  bench_begin();
+  for (i = 0; i < RUNS; i++)
+    sink = dedup_check(&d, (i & 1)?&a:&b, 1, (uint8_t)(i >> 1));
+  bench_end("dedup check", RUNS);
+}
+
+
+/*******************************************************************************
+  presence.c and home.c: the decisions taken at every sample and command
+*******************************************************************************/
+static void bench_logic(void){
+  struct home_state state;
+  struct presence p;
+  clock_time_t interval = SENSING_MIN_INTERVAL;
+  uint8_t type;
+  long i;
+
+  presence_init(&p);
+
+  bench_begin();
+  for (i = 0; i < RUNS; i++){
+    sink = presence_update(&p, (int)(i % 41), interval);
+    interval = presence_next_interval(&p, interval, (int)(i % 41));
+  }
+  bench_end("presence update + interval", RUNS);
+
+  home_init(&state);
+
+  bench_begin();
+  for (i = 0; i < RUNS; i++){
+    if (home_command_allowed(&state, (int)(i % 10) + 1))
+      home_apply(&state, (int)(i % 10) + 1);
+    sink = home_command_route((int)(i % 10) + 1, &type);
+  }
+  bench_end("home command", RUNS);
+}
+
+
+int main(void){
+  bench_window();
+  bench_decibel();
+  bench_burst();
+  bench_series();
+  bench_dedup();
+  bench_logic();
+
+  return 0;
+}
@@ -0,0 +1,484 @@
+/*******************************************************************************
+  Unit tests of the hardware-independent units, run on the host (make test).
+
+  Every unit is checked against a straightforward reference: the running
+  statistics of the window against a scan of the samples, the fixed point dB
+  against log10, the series against the samples it was built from, the
+  history against the samples written before a compaction and a reboot. The
+  program prints every failed check and exits with 1 if there is any.
+*******************************************************************************/
+#include "contiki.h"
+#include "stdio.h"
+#include "math.h"
+#include "message.h"
+#include "home.h"
+#include "presence.h"
+#include "window.h"
+#include "decibel.h"
+#include "burst.h"
+#include "series.h"
+#include "dedup.h"
+#include "history.h"
+#include "cfs/cfs.h"
+
+static int checks, failures;
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+static void check(int ok, const char *what, const char *file, int line){
+  checks++;
+  if (!ok){
+    failures++;
+    printf("%s:%d: check failed: %s\n", file, line, what);
+  }
+}
+
+
+//same sequence at every run
+static unsigned long seed = 1;
+
+static int16_t pseudo_random(int16_t low, int16_t high){
+  seed = seed * 1103515245 + 12345;
+  return low + (int16_t)((seed >> 16) % (unsigned long)(high - low + 1));
+}
+
+
+/*******************************************************************************
+  home.c
+*******************************************************************************/
+static void test_home(void){
+  struct home_state state;
+  uint8_t type;
+
+  home_init(&state);
+  CHECK(state.alarm_state == 0 && state.gate_locked == 1 &&
+                                                  state.extension_active == 0);
+
+  CHECK(home_command_allowed(&state, MSG_CMD_OPEN));
+  CHECK(home_apply(&state, MSG_CMD_GATE) == 1 && state.gate_locked == 0);
+  CHECK(home_apply(&state, MSG_CMD_EXTENSION) == 1 &&
+                                                  state.extension_active == 1);
+  CHECK(home_apply(&state, MSG_CMD_TEMPERATURE) == 0);
+
+  //while the alarm is on only its deactivation is accepted
+  CHECK(home_apply(&state, MSG_CMD_ALARM) == 1 && state.alarm_state == 1);
+  CHECK(!home_command_allowed(&state, MSG_CMD_OPEN));
+  CHECK(!home_command_allowed(&state, MSG_CMD_GATE));
+  CHECK(home_command_allowed(&state, MSG_CMD_ALARM));
+  home_apply(&state, MSG_CMD_ALARM);
+  CHECK(state.alarm_state == 0 && home_command_allowed(&state, MSG_CMD_OPEN));
+
+  //the commands that change the state travel as a state vector
+  CHECK(home_command_route(MSG_CMD_ALARM, &type) == DEST_REGULAR_NODES &&
+                                                      type == MSG_TLV_STATE);
+  CHECK(home_command_route(MSG_CMD_GATE, &type) == DEST_NODE2 &&
+                                                      type == MSG_TLV_STATE);
+  CHECK(home_command_route(MSG_CMD_EXTENSION, &type) == DEST_EXTENSION_NODE &&
+                                                      type == MSG_TLV_STATE);
+  CHECK(home_command_route(MSG_CMD_OPEN, &type) == DEST_REGULAR_NODES &&
+                                                      type == MSG_CMD_OPEN);
+  CHECK(home_command_route(MSG_CMD_LIGHT, &type) == DEST_NODE2 &&
+                                                      type == MSG_CMD_LIGHT);
+  CHECK(home_command_route(MSG_CMD_TEMPERATURE, &type) == DEST_NODE1 &&
+                                                type == MSG_CMD_TEMPERATURE);
+  CHECK(home_command_route(MSG_CMD_HISTORY, &type) == DEST_NODE1);
+  CHECK(home_command_route(MSG_CMD_UPLOAD, &type) == DEST_REGULAR_NODES);
+  CHECK(home_command_route(0, &type) == -1);
+}
+
+
+/*******************************************************************************
+  presence.c
+*******************************************************************************/
+static void test_presence(void){
+  struct presence p;
+  clock_time_t t, interval;
+  int result = PRESENCE_UNCHANGED;
+
+  presence_init(&p);
+
+  //someone arrives after TIME_TO_ACTIVATE of continuous noise
+  for (t = 0; t < TIME_TO_ACTIVATE - CLOCK_SECOND; t += CLOCK_SECOND)
+    CHECK(presence_update(&p, DB_THRESHOLD + 10, CLOCK_SECOND) ==
+                                                          PRESENCE_UNCHANGED);
+  CHECK(presence_update(&p, DB_THRESHOLD + 10, CLOCK_SECOND) ==
+                                                            PRESENCE_ARRIVED);
+  CHECK(p.human_sensed);
+
+  //a pause of silence starts the count again
+  presence_update(&p, DB_THRESHOLD, TIME_TO_DEACTIVATE - CLOCK_SECOND);
+  presence_update(&p, DB_THRESHOLD + 10, CLOCK_SECOND);
+  CHECK(p.silence_time == 0);
+  CHECK(presence_update(&p, DB_THRESHOLD, TIME_TO_DEACTIVATE - CLOCK_SECOND) ==
+                                                          PRESENCE_UNCHANGED);
+  CHECK(presence_update(&p, DB_THRESHOLD, CLOCK_SECOND) == PRESENCE_LEFT);
+  CHECK(!p.human_sensed);
+
+  //stable room: the interval doubles up to the max
+  interval = SENSING_MIN_INTERVAL;
+  while (interval < SENSING_MAX_INTERVAL){
+    result = presence_update(&p, 0, interval);
+    interval = presence_next_interval(&p, interval, 0);
+  }
+  CHECK(result == PRESENCE_UNCHANGED && interval == SENSING_MAX_INTERVAL);
+  CHECK(presence_next_interval(&p, interval, 0) == SENSING_MAX_INTERVAL);
+
+  //close to the threshold, or a change in progress: back to the min
+  CHECK(presence_next_interval(&p, interval, DB_THRESHOLD) ==
+                                                        SENSING_MIN_INTERVAL);
+  presence_update(&p, DB_THRESHOLD + SENSING_GUARD_DB + 1, CLOCK_SECOND);
+  CHECK(presence_next_interval(&p, interval,
+                  DB_THRESHOLD + SENSING_GUARD_DB + 1) == SENSING_MIN_INTERVAL);
+}
+
+
+/*******************************************************************************
+  window.c: every statistic against a scan of the last samples
+*******************************************************************************/
+#define TEST_WINDOW_SIZE 50
+WINDOW(sample_window, TEST_WINDOW_SIZE);
+
+static void test_window(void){
+  int16_t samples[1000];
+  long sum, sum_sq;
+  int16_t min, max;
+  int i, j, first, n;
+
+  window_init(&sample_window);
+  CHECK(window_count(&sample_window) == 0 && window_mean(&sample_window) == 0 &&
+                                            window_variance(&sample_window) == 0);
+
+  for (i = 0; i < 1000; i++){
+    samples[i] = pseudo_random(-100, 100);
+    window_add(&sample_window, samples[i]);
+
+    first = (i + 1 > TEST_WINDOW_SIZE)?i + 1 - TEST_WINDOW_SIZE:0;
+    n = i + 1 - first;
+    sum = sum_sq = 0;
+    min = max = samples[first];
+    for (j = first; j <= i; j++){
+      sum += samples[j];
+      sum_sq += (long)samples[j] * samples[j];
+      if (samples[j] < min)
+        min = samples[j];
+      if (samples[j] > max)
+        max = samples[j];
+    }
+
+    CHECK(window_count(&sample_window) == n);
+    CHECK(window_mean(&sample_window) == (int16_t)(sum / n));
+    CHECK(window_min(&sample_window) == min);
+    CHECK(window_max(&sample_window) == max);
+    CHECK(window_variance(&sample_window) ==
+                                (unsigned long)((sum_sq - sum * sum / n) / n));
+  }
+}
+
+
+/*******************************************************************************
+  decibel.c: the fixed point version against log10
+*******************************************************************************/
+static void test_decibel(void){
+  int mv, adc;
+
+  CHECK(decibel_from_mv(0) == 0 && decibel_from_mv(-5) == 0);
+  CHECK(decibel_from_mv(1) == 0);
+
+  for (mv = 1; mv <= 0xffff; mv++)
+    if (decibel_from_mv(mv) != (int)(20 * log10((double)mv) + 1e-9)){
+      CHECK(0 && "decibel_from_mv matches 20*log10");
+      printf("  mv %d: %d\n", mv, decibel_from_mv(mv));
+      break;
+    }
+
+  for (adc = 0; adc < 4096; adc++)
+    if (decibel_adc_to_mv(adc) != (int)((double)adc * 3300 / 4096 * 5000 / 3000
+                                                                    + 1e-9)){
+      CHECK(0 && "decibel_adc_to_mv matches the floating point conversion");
+      printf("  adc %d: %d\n", adc, decibel_adc_to_mv(adc));
+      break;
+    }
+}
+
+
+/*******************************************************************************
+  burst.c
+*******************************************************************************/
+static void test_burst(void){
+  struct burst b;
+  struct burst_level level;
+  unsigned long sum_sq = 0;
+  int i;
+
+  burst_init(&b);
+  burst_analyse(&b, &level);
+  CHECK(level.rms == 0 && level.peak == 0);
+
+  //constant signal: the rms is the signal
+  for (i = 0; i < BURST_SAMPLES; i++){
+    CHECK(!burst_full(&b));
+    burst_add(&b, 1000);
+  }
+  CHECK(burst_full(&b));
+  burst_analyse(&b, &level);
+  CHECK(level.rms == 1000 && level.peak == 1000);
+
+  //the ring keeps the last BURST_SAMPLES samples
+  for (i = 0; i < 3*BURST_SAMPLES/2; i++)
+    burst_add(&b, (uint16_t)pseudo_random(0, 4000));
+  burst_add(&b, 4095);
+  for (i = 0; i < BURST_SAMPLES; i++)
+    sum_sq += (unsigned long)b.samples[i] * b.samples[i];
+  burst_analyse(&b, &level);
+  CHECK(level.peak == 4095);
+  CHECK(level.rms == (uint16_t)sqrt((double)(sum_sq / BURST_SAMPLES)));
+
+  //the largest samples: the sum of the squares still fits
+  burst_init(&b);
+  for (i = 0; i < BURST_SAMPLES; i++)
+    burst_add(&b, 4095);
+  burst_analyse(&b, &level);
+  CHECK(level.rms == 4095);
+
+  //integer square root, truncated
+  burst_init(&b);
+  burst_add(&b, 3);
+  burst_add(&b, 4);
+  burst_analyse(&b, &level);
+  CHECK(level.rms == (uint16_t)sqrt((9 + 16) / 2));
+}
+
+
+/*******************************************************************************
+  series.c: the samples come back from the block, with their age
+*******************************************************************************/
+static void test_series(void){
+  static struct series s;
+  struct series_reader r;
+  int16_t samples[SERIES_SIZE], value;
+  unsigned long age;
+  uint16_t len, n, i;
+
+  series_init(&s, MSG_TLV_TEMPERATURE, 10);
+  len = series_encode(&s, 0);
+  CHECK(len == SERIES_HDR_LEN);
+  CHECK(series_open(&r, s.block, len) == 0 && r.count == 0);
+  CHECK(series_next(&r, &value, &age) == 0);
+
+  //a slowly changing reading: a byte per sample, 2 for the first one
+  for (n = 0; n < SERIES_SIZE; n++){
+    samples[n] = 240 + pseudo_random(-3, 3);
+    if (series_add(&s, samples[n], 100 + 10*n) < 0)
+      break;
+  }
+  CHECK(n == SERIES_SIZE - 3);
+  CHECK(series_add(&s, 0, 100 + 10*n) < 0);
+
+  len = series_encode(&s, 100 + 10*(n - 1) + 5);
+  CHECK(series_open(&r, s.block, len) == 0);
+  CHECK(r.reading == MSG_TLV_TEMPERATURE && r.period == 10 && r.count == n &&
+                                                                  r.age == 5);
+  for (i = 0; i < n; i++){
+    CHECK(series_next(&r, &value, &age) == 1);
+    CHECK(value == samples[i]);
+    CHECK(age == 5 + (unsigned long)(n - 1 - i) * 10);
+  }
+  CHECK(series_next(&r, &value, &age) == 0);
+
+  //the extremes of int16 take 3 bytes
+  series_reset(&s);
+  CHECK(series_add(&s, 32767, 0) == 0);
+  CHECK(series_add(&s, -32768, 0) == 0);
+  CHECK(series_add(&s, 32767, 0) == 0);
+  CHECK(s.len == 9);
+  len = series_encode(&s, 0);
+  series_open(&r, s.block, len);
+  CHECK(series_next(&r, &value, &age) == 1 && value == 32767);
+  CHECK(series_next(&r, &value, &age) == 1 && value == -32768);
+  CHECK(series_next(&r, &value, &age) == 1 && value == 32767);
+
+  //a truncated block
+  series_open(&r, s.block, len - 1);
+  series_next(&r, &value, &age);
+  series_next(&r, &value, &age);
+  CHECK(series_next(&r, &value, &age) == -1);
+  CHECK(series_open(&r, s.block, SERIES_HDR_LEN - 1) == -1);
+
+  //a block is accepted only if its samples end exactly at its end
+  CHECK(series_check(s.block, len) == 0);
+  CHECK(series_check(s.block, len - 1) == -1);
+  CHECK(series_check(s.block, SERIES_HDR_LEN - 1) == -1);
+  s.block[len] = 0;
+  CHECK(series_check(s.block, len + 1) == -1);
+  //a header that does not match the samples
+  s.block[3]++;
+  CHECK(series_check(s.block, len) == -1);
+  s.block[3] -= 2;
+  CHECK(series_check(s.block, len) == -1);
+  s.block[3]++;
+  CHECK(series_check(s.block, len) == 0);
+}
+
+
+/*******************************************************************************
+  dedup.c
+*******************************************************************************/
+static void test_dedup(void){
+  struct dedup d;
+  linkaddr_t a = {{1, 0}}, b = {{2, 0}}, c = {{3, 0}};
+  unsigned int i;
+
+  dedup_init(&d);
+
+  CHECK(dedup_check(&d, &a, 1, 10) == 1);
+  CHECK(dedup_check(&d, &a, 1, 10) == 0);
+  CHECK(dedup_check(&d, &a, 1, 12) == 1);
+  //late but not seen yet, then a duplicate
+  CHECK(dedup_check(&d, &a, 1, 11) == 1);
+  CHECK(dedup_check(&d, &a, 1, 11) == 0);
+
+  //every sender has its own window
+  CHECK(dedup_check(&d, &b, 1, 10) == 1);
+  CHECK(dedup_check(&d, &a, 1, 12) == 0);
+
+  //the counter wraps around
+  for (i = 13; i < 300; i++)
+    CHECK(dedup_check(&d, &a, 1, (uint8_t)i) == 1);
+  CHECK(dedup_check(&d, &a, 1, (uint8_t)299) == 0);
+  CHECK(dedup_check(&d, &a, 1, (uint8_t)(299 - DEDUP_WINDOW + 1)) == 0);
+
+  //far behind the window: the sender has rebooted
+  CHECK(dedup_check(&d, &a, 1, (uint8_t)(299 - 100)) == 1);
+  CHECK(dedup_check(&d, &a, 1, (uint8_t)(299 - 100)) == 0);
+
+  //the sender reboots after a few frames: its new sequence numbers are still
+  //in the window, only the new epoch tells them apart from duplicates
+  for (i = 0; i < 4; i++)
+    CHECK(dedup_check(&d, &b, 2, (uint8_t)i) == 1);
+  for (i = 0; i < 4; i++){
+    CHECK(dedup_check(&d, &b, 3, (uint8_t)i) == 1);
+    CHECK(dedup_check(&d, &b, 3, (uint8_t)i) == 0);
+  }
+  //the flash of the sender has been erased: its counter starts again
+  CHECK(dedup_check(&d, &b, 1, 0) == 1);
+
+  //a third sender takes the place of the oldest one
+  CHECK(dedup_check(&d, &c, 1, 5) == 1);
+  CHECK(dedup_check(&d, &c, 1, 5) == 0);
+}
+
+
+/*******************************************************************************
+  history.c, on files of the host (cfs-posix): a sample every 10 seconds,
+  100 in the first raw segment and 200 after it, until the ring of raw
+  segments wraps around and the first one is compacted
+*******************************************************************************/
+#define HISTORY_PERIOD 10
+#define HISTORY_SAMPLES ((HISTORY_RAW_SEGMENTS + 1) * HISTORY_SEGMENT_RECORDS)
+
+//clock of the history (see history_now)
+static unsigned long seconds;
+
+unsigned long clock_seconds(void){
+  return seconds;
+}
+
+
+static void remove_history(void){
+  char name[12];
+  int n;
+
+  for (n = 0; n < HISTORY_RAW_SEGMENTS; n++){
+    sprintf(name, "hist0.%d", n);
+    cfs_remove(name);
+  }
+  for (n = 0; n < HISTORY_COMPACT_SEGMENTS; n++){
+    sprintf(name, "hist1.%d", n);
+    cfs_remove(name);
+  }
+}
+
+
+//time of the sample i of the first boot: the history starts at 1
+static unsigned long sample_time(unsigned long i){
+  return 1 + i * HISTORY_PERIOD;
+}
+
+
+static void test_history(void){
+  struct history_stats stats;
+  unsigned long i, last, rebooted;
+
+  remove_history();
+  seconds = 0;
+  history_init();
+  CHECK(history_now() == sample_time(0));
+
+  //a few samples are still in the batch, not on the file
+  for (i = 0; i < HISTORY_SAMPLES + 10; i++){
+    seconds = i * HISTORY_PERIOD;
+    history_add((i < HISTORY_SEGMENT_RECORDS)?100:200);
+  }
+  last = sample_time(i - 1);
+
+  //everything: compacted, raw and batch
+  CHECK(history_query(0, last, &stats) == HISTORY_SAMPLES + 10);
+  CHECK(stats.min == 100 && stats.max == 200);
+
+  //only the compacted segment
+  CHECK(history_query(0, sample_time(HISTORY_SEGMENT_RECORDS - 1), &stats)
+                                                  == HISTORY_SEGMENT_RECORDS);
+  CHECK(stats.mean == 100 && stats.min == 100 && stats.max == 100);
+
+  //across the compacted and the raw samples: two compacted records and
+  //2*HISTORY_COMPACT raw samples
+  CHECK(history_query(sample_time(HISTORY_SEGMENT_RECORDS - 2*HISTORY_COMPACT),
+         sample_time(HISTORY_SEGMENT_RECORDS + 2*HISTORY_COMPACT - 1), &stats)
+                                                        == 4*HISTORY_COMPACT);
+  CHECK(stats.mean == 150 && stats.min == 100 && stats.max == 200);
+
+  //a compacted record counts only if its time is in the window
+  CHECK(history_query(sample_time(HISTORY_SEGMENT_RECORDS - HISTORY_COMPACT
+                                      - 1), last, &stats)
+                        == HISTORY_SAMPLES + 10 - HISTORY_SEGMENT_RECORDS
+                                                          + HISTORY_COMPACT);
+
+  //only the batch
+  CHECK(history_query(sample_time(HISTORY_SAMPLES), last, &stats) == 10);
+  CHECK(stats.mean == 200);
+
+  //reboot: the batch is lost, the time goes on from the last record written
+  seconds = 0;
+  history_init();
+  rebooted = history_now();
+  CHECK(rebooted == sample_time(HISTORY_SAMPLES - 1) + 1);
+  CHECK(history_query(0, rebooted, &stats) == HISTORY_SAMPLES);
+
+  //a batch after the reboot compacts the next raw segment
+  for (i = 0; i < HISTORY_BATCH; i++){
+    seconds = i * HISTORY_PERIOD;
+    history_add(300);
+  }
+  CHECK(history_query(rebooted, history_now(), &stats) == HISTORY_BATCH);
+  CHECK(stats.mean == 300 && stats.min == 300);
+  CHECK(history_query(0, rebooted - 1, &stats) == HISTORY_SAMPLES);
+  CHECK(stats.max == 200);
+
+  remove_history();
+}
+
+
+int main(void){
+  test_home();
+  test_presence();
+  test_window();
+  test_decibel();
+  test_burst();
+  test_series();
+  test_dedup();
+  test_history();
+
+  printf("%d checks, %d failed\n", checks, failures);
+
+  return (failures > 0)?1:0;
+}
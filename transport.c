@@ -0,0 +1,106 @@
+#include "contiki.h"
+#include "net/rime/rime.h"
+#include "stdio.h"
+#include "message.h"
+#include "transport.h"
+
+#if TRANSPORT_CONF_MULTIHOP
+
+#include "net/rime/collect.h"
+#include "net/rime/collect-link-estimate.h"
+#include "net/rime/mesh.h"
+
+static const struct transport_callbacks *cb;
+static struct collect_conn collect;
+static struct mesh_conn mesh;
+//a frame is waiting for the discovery of its route
+static uint8_t discovering = 0;
+
+
+static void collect_recv(const linkaddr_t *originator, uint8_t seqno,
+                                                              uint8_t hops){
+  cb->recv(originator, hops);
+}
+
+
+static void mesh_recv(struct mesh_conn *c, const linkaddr_t *from,
+                                                              uint8_t hops){
+  cb->recv(from, hops);
+}
+
+
+static void mesh_sent(struct mesh_conn *c){
+  discovering = 0;
+
+  if (cb->ready != NULL)
+    cb->ready();
+}
+
+
+static void mesh_timedout(struct mesh_conn *c){
+  printf("mesh: no route found, frame dropped\n");
+  discovering = 0;
+
+  if (cb->ready != NULL)
+    cb->ready();
+}
+
+
+static const struct collect_callbacks collect_calls = {collect_recv};
+static const struct mesh_callbacks mesh_calls = {mesh_recv, mesh_sent,
+                                                                mesh_timedout};
+
+
+void transport_open(int sink, const struct transport_callbacks *callbacks){
+  cb = callbacks;
+
+  //every node relays the frames of the others
+  collect_open(&collect, TRANSPORT_COLLECT_CHANNEL, COLLECT_ROUTER,
+                                                              &collect_calls);
+  if (sink)
+    collect_set_sink(&collect, 1);
+
+  mesh_open(&mesh, TRANSPORT_MESH_CHANNEL, &mesh_calls);
+}
+
+
+int transport_send_to_node(const linkaddr_t *to){
+  if (discovering)
+    return -1;
+
+  //0: no route yet, mesh keeps the frame until the route is found
+  if (!mesh_send(&mesh, to))
+    discovering = 1;
+
+  return 0;
+}
+
+
+int transport_busy(void){
+  return discovering;
+}
+
+
+int transport_append_route(void){
+  uint8_t buf[6];
+  const linkaddr_t *parent = collect_parent(&collect);
+
+  buf[0] = parent->u8[0];
+  buf[1] = parent->u8[1];
+  //ETX of the path to the CU and of the link to the parent
+  msg_put_u16(buf + 2, collect_depth(&collect));
+  msg_put_u16(buf + 4, collect_parent_link_metric(&collect));
+
+  return msg_append(MSG_TLV_ROUTE, buf, sizeof(buf));
+}
+
+#endif /* TRANSPORT_CONF_MULTIHOP */
+
+
+int transport_send_to_cu(struct sendqueue *sq){
+#if TRANSPORT_CONF_MULTIHOP
+  return collect_send(&collect, TRANSPORT_MAX_RETRANSMISSIONS)?0:-1;
+#else
+  return sendqueue_send(sq);
+#endif
+}
@@ -0,0 +1,66 @@
+#ifndef TRANSPORT_H_
+#define TRANSPORT_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+#include "sendqueue.h"
+
+/*******************************************************************************
+  Multi-hop transport (make TRANSPORT=multihop, TRANSPORT_CONF_MULTIHOP).
+
+  The default transport is single hop: broadcast and runicast on the channels
+  128-131, every node must be in radio range of the CU. The multi-hop one lets
+  the nodes relay the frames of the others:
+    - node -> CU (replies, pushed readings, errors, energy reports): Rime
+      collect, the CU is the sink of the tree and every node is a router
+    - CU -> node (commands): Rime mesh, the route to a node is discovered the
+      first time and then reused. Mesh keeps a single frame waiting for a
+      route, so the CU sends one frame at a time: transport_busy() tells when
+      the previous one is still waiting and the ready callback when it is done.
+      There is no broadcast over several hops: the commands for the regular
+      nodes are sent to each of them.
+  The frames are the same of the single hop transport (message.h).
+
+  Every energy report of a node carries its route (MSG_TLV_ROUTE): the parent in
+  the collect tree, the ETX of the path to the CU and the ETX of the link to the
+  parent, printed by the CU with the report.
+*******************************************************************************/
+
+//collect uses 2 channels, mesh 3
+#define TRANSPORT_COLLECT_CHANNEL 133
+#define TRANSPORT_MESH_CHANNEL    135
+
+#define TRANSPORT_MAX_RETRANSMISSIONS 4
+
+struct transport_callbacks {
+  //a frame from a node (or the CU), hops away, is in the packetbuf
+  void (*recv)(const linkaddr_t *from, uint8_t hops);
+  //the transport can take a new frame for a node (may be NULL)
+  void (*ready)(void);
+};
+
+/*
+  join the collect tree and the mesh. The CU is the sink of the tree
+*/
+void transport_open(int sink, const struct transport_callbacks *callbacks);
+
+/*
+  send the frame in the packetbuf to the CU. sq is the queue of the runicast
+  connection with the CU, used by the single hop transport only
+*/
+int transport_send_to_cu(struct sendqueue *sq);
+
+/*
+  send the frame in the packetbuf to a node. Return -1 if the frame before is
+  still waiting for its route
+*/
+int transport_send_to_node(const linkaddr_t *to);
+
+int transport_busy(void);
+
+/*
+  append the route of the node to the frame in the packetbuf
+*/
+int transport_append_route(void);
+
+#endif /* TRANSPORT_H_ */
@@ -0,0 +1,109 @@
+#include "window.h"
+
+
+void window_init(struct window *w){
+  w->count = 0;
+  w->next = 0;
+  w->sum = 0;
+  w->sum_sq = 0;
+  w->min_head = w->min_len = 0;
+  w->max_head = w->max_len = 0;
+}
+
+
+/*******************************************************************************
+  push a slot at the back of a monotonic deque, after removing the slots that
+  can not become the min (or max) anymore. less != 0 keeps the min
+*******************************************************************************/
+static void deque_push(struct window *w, uint16_t *slots, uint16_t head,
+                              uint16_t *len, uint16_t slot, int less){
+  int16_t sample = w->samples[slot];
+  int16_t back;
+
+  while (*len > 0){
+    back = w->samples[slots[(head + *len - 1) % w->size]];
+
+    if ((less && back < sample) || (!less && back > sample))
+      break;
+
+    (*len)--;
+  }
+
+  slots[(head + *len) % w->size] = slot;
+  (*len)++;
+}
+
+
+void window_add(struct window *w, int16_t sample){
+  int16_t old;
+
+  if (w->count == w->size){
+    //the oldest sample leaves the window
+    old = w->samples[w->next];
+    w->sum -= old;
+    w->sum_sq -= (long)old * old;
+
+    //being the oldest, if it is in a deque it is at the front
+    if (w->min_len > 0 && w->min_slots[w->min_head] == w->next){
+      w->min_head = (w->min_head + 1) % w->size;
+      w->min_len--;
+    }
+    if (w->max_len > 0 && w->max_slots[w->max_head] == w->next){
+      w->max_head = (w->max_head + 1) % w->size;
+      w->max_len--;
+    }
+  }
+  else
+    w->count++;
+
+  w->samples[w->next] = sample;
+  w->sum += sample;
+  w->sum_sq += (long)sample * sample;
+
+  deque_push(w, w->min_slots, w->min_head, &w->min_len, w->next, 1);
+  deque_push(w, w->max_slots, w->max_head, &w->max_len, w->next, 0);
+
+  w->next = (w->next + 1) % w->size;
+}
+
+
+uint16_t window_count(const struct window *w){
+  return w->count;
+}
+
+
+int16_t window_mean(const struct window *w){
+  if (w->count == 0)
+    return 0;
+
+  return (int16_t)(w->sum / w->count);
+}
+
+
+int16_t window_min(const struct window *w){
+  if (w->count == 0)
+    return 0;
+
+  return w->samples[w->min_slots[w->min_head]];
+}
+
+
+int16_t window_max(const struct window *w){
+  if (w->count == 0)
+    return 0;
+
+  return w->samples[w->max_slots[w->max_head]];
+}
+
+
+unsigned long window_variance(const struct window *w){
+  long mean_sq;
+
+  if (w->count == 0)
+    return 0;
+
+  //E[x^2] - E[x]^2
+  mean_sq = (w->sum * w->sum) / w->count;
+
+  return (w->sum_sq - mean_sq) / w->count;
+}
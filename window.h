@@ -0,0 +1,54 @@
+#ifndef WINDOW_H_
+#define WINDOW_H_
+
+#include <stdint.h>
+
+/*******************************************************************************
+  Sliding window of the last N samples with running statistics.
+
+  Every statistic is updated when a sample is added, so reading the mean, the
+  min, the max or the variance costs O(1) whatever the size of the window:
+    - sum and sum of squares are updated by adding the new sample and removing
+      the one that leaves the window
+    - min and max are kept by two monotonic deques of slot indexes, the front
+      of each deque is the current min/max (amortized O(1) per sample)
+
+  The sums are kept on 32 bits: the sum of squares is exact as long as
+  size * sample^2 fits, e.g. |sample| <= 100 with a window of 400 samples.
+*******************************************************************************/
+
+struct window {
+  int16_t *samples;
+  uint16_t *min_slots;
+  uint16_t *max_slots;
+  uint16_t size;
+
+  uint16_t count;       //samples in the window (at most size)
+  uint16_t next;        //slot of the next sample, the oldest one when full
+  long sum;
+  unsigned long sum_sq;
+
+  uint16_t min_head, min_len;
+  uint16_t max_head, max_len;
+};
+
+/*
+  declare a window of size samples and its storage
+*/
+#define WINDOW(name, size)                                                    \
+  static int16_t name##_samples[size];                                        \
+  static uint16_t name##_min_slots[size], name##_max_slots[size];             \
+  static struct window name = { name##_samples, name##_min_slots,             \
+                                name##_max_slots, size }
+
+void window_init(struct window *w);
+void window_add(struct window *w, int16_t sample);
+
+uint16_t window_count(const struct window *w);
+//the statistics of an empty window are 0
+int16_t window_mean(const struct window *w);
+int16_t window_min(const struct window *w);
+int16_t window_max(const struct window *w);
+unsigned long window_variance(const struct window *w);
+
+#endif /* WINDOW_H_ */